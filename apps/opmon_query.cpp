@@ -0,0 +1,743 @@
+/**
+ * @file opmon_query.cpp
+ *
+ * Select value series from files written by fileOpmonService, by path glob
+ * and time range, and write them out as CSV or as a columnar binary file.
+ *
+ * Every line is parsed with nlohmann's SAX interface, so no DOM is built.
+ * Files written by tsfileOpmonService (see TimeSeries.hpp), and by
+ * fileOpmonService with ?encoding=schema (see SchemaCodec.hpp), are read as well.
+ * A series is named "<node path>/<info type>/<field>", e.g.
+ * "partition.module/mymodule.Info/queue_size"; elements of arrays are named
+ * "field[i]" and members of nested objects "field.member".
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/SchemaCodec.hpp"
+#include "opmonlib/TimeSeries.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <fnmatch.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Query
+{
+  std::vector<std::string> globs;
+  int64_t from = std::numeric_limits<int64_t>::min();
+  int64_t to = std::numeric_limits<int64_t>::max();
+};
+
+struct Row
+{
+  int64_t time;
+  std::string series;
+  double value;
+  std::string text; ///< Set instead of value for string fields
+  bool numeric;
+};
+
+// Glob match on series names, remembering the answer for each name
+class Selector
+{
+public:
+  explicit Selector(const Query& query)
+    : m_query(query)
+  {}
+
+  bool operator()(const std::string& series)
+  {
+    if (m_query.globs.empty())
+      return true;
+    auto it = m_selected.find(series);
+    if (it != m_selected.end())
+      return it->second;
+    bool match = false;
+    for (auto& g : m_query.globs)
+      match = match || fnmatch(g.c_str(), series.c_str(), 0) == 0;
+    m_selected.emplace(series, match);
+    return match;
+  }
+
+private:
+  const Query& m_query;
+  std::unordered_map<std::string, bool> m_selected;
+};
+
+/**
+ * @brief SAX handler turning one opmon snapshot into rows
+ *
+ * Field values of an info block are buffered until the end of the block,
+ * because "__time" is serialised after "__data".
+ */
+class SnapshotHandler : public nlohmann::json::json_sax_t
+{
+public:
+  SnapshotHandler(const Query& query, Selector& selected, std::vector<Row>& rows)
+    : m_query(query)
+    , m_selected(selected)
+    , m_rows(rows)
+  {}
+
+  bool null() override { return true; }
+  bool boolean(bool val) override { return value(val ? 1. : 0., std::string(), true); }
+  bool number_integer(number_integer_t val) override { return value(static_cast<double>(val), std::string(), true); }
+  bool number_unsigned(number_unsigned_t val) override
+  {
+    return value(static_cast<double>(val), std::string(), true);
+  }
+  bool number_float(number_float_t val, const string_t& /*s*/) override { return value(val, std::string(), true); }
+  bool string(string_t& val) override { return value(0., val, false); }
+  bool binary(binary_t& /*val*/) override { return true; }
+
+  bool start_object(std::size_t /*elements*/) override
+  {
+    bool block = m_frames.size() >= 2 && m_frames[m_frames.size() - 2].key == "__properties" && in_tree();
+    enter(false);
+    if (block) {
+      m_block_depth = m_frames.size();
+      m_block_time = std::numeric_limits<int64_t>::min();
+      m_block.clear();
+    }
+    return true;
+  }
+
+  bool key(string_t& val) override
+  {
+    m_frames.back().key = val;
+    return true;
+  }
+
+  bool end_object() override
+  {
+    if (m_frames.size() == m_block_depth) {
+      if (m_block_time >= m_query.from && m_block_time <= m_query.to) {
+        for (auto& row : m_block) {
+          row.time = m_block_time;
+          m_rows.push_back(std::move(row));
+        }
+      }
+      m_block.clear();
+      m_block_depth = 0;
+    }
+    leave();
+    return true;
+  }
+
+  bool start_array(std::size_t /*elements*/) override
+  {
+    enter(true);
+    return true;
+  }
+
+  bool end_array() override
+  {
+    leave();
+    return true;
+  }
+
+  bool parse_error(std::size_t /*position*/,
+                   const std::string& /*last_token*/,
+                   const nlohmann::detail::exception& /*ex*/) override
+  {
+    return false;
+  }
+
+private:
+  struct Frame
+  {
+    bool array;
+    std::string key;
+    size_t index = 0;
+  };
+
+  void enter(bool array)
+  {
+    if (!m_frames.empty() && m_frames.back().array)
+      m_frames.back().key = std::to_string(m_frames.back().index);
+    m_frames.push_back({ array, std::string() });
+  }
+
+  void leave()
+  {
+    m_frames.pop_back();
+    if (!m_frames.empty() && m_frames.back().array)
+      ++m_frames.back().index;
+  }
+
+  bool in_tree() const { return !m_frames.empty() && m_frames.front().key == "__parent"; }
+
+  bool value(double v, const std::string& text, bool numeric)
+  {
+    if (!m_frames.empty() && m_frames.back().array)
+      m_frames.back().key = std::to_string(m_frames.back().index++);
+    if (m_block_depth == 0 || !in_tree())
+      return true;
+
+    // Path below the info block: "__time" or "__data", field, sub fields...
+    const auto& tag = m_frames[m_block_depth - 1].key;
+    if (tag == "__time" && m_frames.size() == m_block_depth) {
+      m_block_time = static_cast<int64_t>(v);
+      return true;
+    }
+    if (tag != "__data" || m_frames.size() <= m_block_depth)
+      return true;
+
+    std::string series = series_prefix();
+    for (size_t i = m_block_depth; i < m_frames.size(); ++i) {
+      if (m_frames[i].array)
+        series += '[' + m_frames[i].key + ']';
+      else
+        series += (i == m_block_depth ? "" : ".") + m_frames[i].key;
+    }
+    if (!m_selected(series))
+      return true;
+    m_block.push_back({ 0, std::move(series), v, text, numeric });
+    return true;
+  }
+
+  // "<node path>/<info type>/" of the current block; node names sit at every other level
+  std::string series_prefix() const
+  {
+    std::string prefix;
+    for (size_t i = 1; i + 2 < m_block_depth; i += 2)
+      prefix += (prefix.empty() ? "" : ".") + m_frames[i].key;
+    return prefix + '/' + m_frames[m_block_depth - 2].key + '/';
+  }
+
+  const Query& m_query;
+  Selector& m_selected;
+  std::vector<Row>& m_rows;
+  std::vector<Frame> m_frames;
+  size_t m_block_depth = 0;
+  int64_t m_block_time = 0;
+  std::vector<Row> m_block;
+};
+
+const std::string s_schema_prefix = std::string("{\"") + dunedaq::opmonlib::SchemaEncoder::s_schema_tag + '"';
+const std::string s_values_prefix = std::string("{\"") + dunedaq::opmonlib::SchemaEncoder::s_values_tag + '"';
+
+/**
+ * @brief Turns the values messages of a schema encoded file into rows
+ *
+ * The skeleton of each schema is run through SnapshotHandler once, which
+ * gives the series name of every selected field id and the field id of the
+ * time of its block; a values message then only needs these looked up.
+ * Values following a schema other than the last one seen are skipped.
+ */
+class SchemaReader
+{
+public:
+  // `earlier` gives the last schema message before the text being read, if any,
+  // and is only called when a values message comes before any schema
+  SchemaReader(const Query& query, std::function<std::string()> earlier = nullptr)
+    : m_query(query)
+    , m_earlier(std::move(earlier))
+  {}
+
+  void set_schema(const std::string& message)
+  {
+    auto j = nlohmann::json::parse(message);
+    auto& schema = j.at(dunedaq::opmonlib::SchemaEncoder::s_schema_tag);
+    Query all_times;
+    all_times.globs = m_query.globs;
+    Selector selected(all_times);
+    std::vector<Row> rows;
+    SnapshotHandler handler(all_times, selected, rows);
+    auto skeleton = schema.at("skeleton").dump();
+    nlohmann::json::sax_parse(skeleton, &handler);
+
+    m_fields.clear();
+    for (auto& r : rows) {
+      bool timed = r.time != std::numeric_limits<int64_t>::min();
+      m_fields.push_back({ std::move(r.series), static_cast<size_t>(r.value), static_cast<size_t>(r.time), timed });
+    }
+    m_id = schema.at("id").get<uint64_t>(); // NOLINT(build/unsigned)
+    m_has_schema = true;
+  }
+
+  void read_values(const std::string& message, std::vector<Row>& rows)
+  {
+    if (!m_has_schema && m_earlier) {
+      auto schema = m_earlier();
+      m_earlier = nullptr;
+      if (!schema.empty())
+        set_schema(schema);
+    }
+    auto j = nlohmann::json::parse(message);
+    auto& values = j.at(dunedaq::opmonlib::SchemaEncoder::s_values_tag);
+    if (!m_has_schema || values.at("schema").get<uint64_t>() != m_id) // NOLINT(build/unsigned)
+      return;
+    auto& data = values.at("data");
+    for (auto& f : m_fields) {
+      int64_t time = f.timed ? data.at(f.time).get<int64_t>() : std::numeric_limits<int64_t>::min();
+      if (time < m_query.from || time > m_query.to)
+        continue;
+      auto& v = data.at(f.value);
+      if (v.is_number() || v.is_boolean())
+        rows.push_back({ time, f.series, v.is_boolean() ? (v.get<bool>() ? 1. : 0.) : v.get<double>(), {}, true });
+      else if (v.is_string())
+        rows.push_back({ time, f.series, 0., v.get<std::string>(), false });
+    }
+  }
+
+private:
+  struct Field
+  {
+    std::string series;
+    size_t value; ///< Field id of the value
+    size_t time;  ///< Field id of the time of its block
+    bool timed;
+  };
+
+  const Query& m_query;
+  std::function<std::string()> m_earlier;
+  bool m_has_schema = false;
+  uint64_t m_id = 0; // NOLINT(build/unsigned)
+  std::vector<Field> m_fields;
+};
+
+// Last schema message in `text`, empty if there is none
+std::string
+last_schema(const std::string& text)
+{
+  auto pos = text.rfind('\n' + s_schema_prefix);
+  if (pos != std::string::npos)
+    ++pos;
+  else if (text.compare(0, s_schema_prefix.size(), s_schema_prefix) == 0)
+    pos = 0;
+  else
+    return std::string();
+  auto end = text.find('\n', pos);
+  return text.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+}
+
+// Parse every complete line of `text`, appending selected rows
+void
+parse_lines(const std::string& text, const Query& query, SchemaReader& schema, std::vector<Row>& rows)
+{
+  Selector selected(query);
+  size_t start = 0;
+  while (start < text.size()) {
+    auto end = text.find('\n', start);
+    if (end == std::string::npos)
+      end = text.size();
+    if (end > start) {
+      bool ok = true;
+      bool is_schema = text.compare(start, s_schema_prefix.size(), s_schema_prefix) == 0;
+      if (is_schema || text.compare(start, s_values_prefix.size(), s_values_prefix) == 0) {
+        try {
+          auto line = text.substr(start, end - start);
+          if (is_schema)
+            schema.set_schema(line);
+          else
+            schema.read_values(line, rows);
+        } catch (const nlohmann::json::exception&) {
+          ok = false;
+        }
+      } else {
+        SnapshotHandler handler(query, selected, rows);
+        ok = nlohmann::json::sax_parse(text.begin() + start, text.begin() + end, &handler);
+      }
+      if (!ok)
+        std::cerr << "Skipping malformed line at offset " << start << std::endl;
+    }
+    start = end + 1;
+  }
+}
+
+// Decode a whole time series file, appending selected rows
+void
+read_time_series(const std::string& file, const Query& query, std::vector<Row>& rows)
+{
+  Selector selected(query);
+  std::ifstream is(file, std::ios::binary);
+  dunedaq::opmonlib::TimeSeriesReader reader;
+  using Sample = dunedaq::opmonlib::TimeSeriesReader::Sample;
+  bool complete = reader.read(is, [&](const std::string& series, const Sample& s) {
+    if (s.time < query.from || s.time > query.to || !selected(series))
+      return;
+    rows.push_back({ s.time, series, s.is_double ? s.real : static_cast<double>(s.integer), std::string(), true });
+  });
+  if (!complete)
+    std::cerr << "Time series file " << file << " is truncated or corrupt, read up to the last complete block"
+              << std::endl;
+}
+
+struct Chunk
+{
+  std::string file;
+  std::streamoff begin;
+  std::streamoff end;
+  bool time_series; ///< Whole tsfileOpmonService file, which can not be split
+};
+
+// Split files into newline aligned chunks of roughly `size` bytes
+std::vector<Chunk>
+make_chunks(const std::vector<std::string>& files, std::streamoff size)
+{
+  std::vector<Chunk> chunks;
+  for (auto& f : files) {
+    std::ifstream is(f, std::ios::binary | std::ios::ate);
+    if (!is) {
+      std::cerr << "Can not open " << f << std::endl;
+      continue;
+    }
+    std::streamoff length = is.tellg();
+    char magic[4] = {};
+    is.seekg(0);
+    is.read(magic, 4);
+    if (is && std::equal(magic, magic + 4, dunedaq::opmonlib::TimeSeriesWriter::s_magic)) {
+      chunks.push_back({ f, 0, length, true });
+      continue;
+    }
+    is.clear();
+    std::streamoff begin = 0;
+    while (begin < length) {
+      std::streamoff end = std::min(begin + size, length);
+      if (end < length) {
+        is.seekg(end);
+        std::string rest;
+        std::getline(is, rest);
+        end = std::min<std::streamoff>(end + rest.size() + 1, length);
+      }
+      chunks.push_back({ f, begin, end, false });
+      begin = end;
+    }
+  }
+  return chunks;
+}
+
+std::string
+read_range(const std::string& file, std::streamoff begin, std::streamoff end)
+{
+  std::ifstream is(file, std::ios::binary);
+  is.seekg(begin);
+  std::string text(static_cast<size_t>(end - begin), '\0');
+  is.read(text.data(), end - begin);
+  text.resize(static_cast<size_t>(is.gcount()));
+  return text;
+}
+
+// CSV field, quoted if it contains a separator, quote or line break (RFC 4180)
+void
+write_csv_field(std::ostream& os, const std::string& field, bool always_quote)
+{
+  if (!always_quote && field.find_first_of(",\"\r\n") == std::string::npos) {
+    os << field;
+    return;
+  }
+  os << '"';
+  for (char c : field) {
+    if (c == '"')
+      os << '"';
+    os << c;
+  }
+  os << '"';
+}
+
+// String values are always quoted, to tell them from numbers
+void
+write_csv(std::ostream& os, const std::vector<Row>& rows)
+{
+  for (auto& r : rows) {
+    os << r.time << ',';
+    write_csv_field(os, r.series, false);
+    os << ',';
+    if (r.numeric)
+      os << r.value;
+    else
+      write_csv_field(os, r.text, true);
+    os << '\n';
+  }
+}
+
+// Time and value columns of each series
+using Columns = std::map<std::string, std::pair<std::vector<int64_t>, std::vector<double>>>;
+
+void
+add_columns(Columns& columns, const std::vector<Row>& rows)
+{
+  for (auto& r : rows) {
+    if (!r.numeric)
+      continue;
+    auto& c = columns[r.series];
+    c.first.push_back(r.time);
+    c.second.push_back(r.value);
+  }
+}
+
+// Order the samples of every series by time, keeping the file order of equal times
+void
+sort_columns(Columns& columns)
+{
+  for (auto& [name, c] : columns) {
+    auto& [times, values] = c;
+    if (std::is_sorted(times.begin(), times.end()))
+      continue;
+    std::vector<size_t> order(times.size());
+    for (size_t i = 0; i < order.size(); ++i)
+      order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return times[a] < times[b]; });
+    std::vector<int64_t> sorted_times(times.size());
+    std::vector<double> sorted_values(values.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      sorted_times[i] = times[order[i]];
+      sorted_values[i] = values[order[i]];
+    }
+    times.swap(sorted_times);
+    values.swap(sorted_values);
+  }
+}
+
+/**
+ * Columnar binary output, all integers little endian:
+ *   "OPMQ" uint32 version(1) uint64 n_series
+ *   per series: uint32 name_length, name, uint64 n, int64 time[n], double value[n]
+ * String values are not written.
+ */
+void
+write_binary(std::ostream& os, const Columns& columns)
+{
+  auto put = [&os](const auto& v) { os.write(reinterpret_cast<const char*>(&v), sizeof(v)); }; // NOLINT
+  os.write("OPMQ", 4);
+  put(uint32_t(1));              // NOLINT(build/unsigned)
+  put(uint64_t(columns.size())); // NOLINT(build/unsigned)
+  for (auto& [name, c] : columns) {
+    put(uint32_t(name.size())); // NOLINT(build/unsigned)
+    os.write(name.data(), name.size());
+    put(uint64_t(c.first.size())); // NOLINT(build/unsigned)
+    os.write(reinterpret_cast<const char*>(c.first.data()), c.first.size() * sizeof(int64_t));  // NOLINT
+    os.write(reinterpret_cast<const char*>(c.second.data()), c.second.size() * sizeof(double)); // NOLINT
+  }
+}
+
+// Keep reading lines appended to `file`, like tail -f; only CSV output
+void
+follow(const std::string& file, const Query& query, std::ostream& os, bool from_start)
+{
+  std::ifstream probe(file, std::ios::binary | std::ios::ate);
+  std::streamoff offset = from_start ? 0 : static_cast<std::streamoff>(probe.tellg());
+  std::string partial;
+  SchemaReader schema(query);
+  for (;;) {
+    std::ifstream is(file, std::ios::binary | std::ios::ate);
+    std::streamoff length = is ? static_cast<std::streamoff>(is.tellg()) : 0;
+    if (length < offset) { // truncated or rotated
+      offset = 0;
+      partial.clear();
+    }
+    if (length > offset) {
+      std::string text = partial + read_range(file, offset, length);
+      offset = length;
+      auto last = text.rfind('\n');
+      partial = last == std::string::npos ? text : text.substr(last + 1);
+      if (last != std::string::npos) {
+        text.resize(last + 1);
+        std::vector<Row> rows;
+        parse_lines(text, query, schema, rows);
+        write_csv(os, rows);
+        os.flush();
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  }
+}
+
+void
+usage(const char* name)
+{
+  std::cerr << "Usage: " << name << " [options] file...\n"
+            << "  -p, --path GLOB     select series matching GLOB (repeatable), e.g. '*/mymodule.Info/queue_*'\n"
+            << "  -s, --from TIME     first time (unix seconds) to select\n"
+            << "  -e, --to TIME       last time (unix seconds) to select\n"
+            << "  -f, --format FMT    csv (default) or binary\n"
+            << "  -o, --output FILE   output file (default: stdout)\n"
+            << "  -j, --threads N     number of parsing threads (default: number of cores)\n"
+            << "  -F, --follow        keep reading data appended to the (single, JSON) input file\n"
+            << "  -h, --help          show this message\n";
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  Query query;
+  std::string format = "csv";
+  std::string output;
+  unsigned threads = std::max(1U, std::thread::hardware_concurrency());
+  bool follow_mode = false;
+
+  static const option long_options[] = {
+    { "path", required_argument, nullptr, 'p' },   { "from", required_argument, nullptr, 's' },
+    { "to", required_argument, nullptr, 'e' },     { "format", required_argument, nullptr, 'f' },
+    { "output", required_argument, nullptr, 'o' }, { "threads", required_argument, nullptr, 'j' },
+    { "follow", no_argument, nullptr, 'F' },       { "help", no_argument, nullptr, 'h' },
+    { nullptr, 0, nullptr, 0 }
+  };
+  int c;
+  while ((c = getopt_long(argc, argv, "p:s:e:f:o:j:Fh", long_options, nullptr)) != -1) {
+    switch (c) {
+      case 'p':
+        query.globs.push_back(optarg);
+        break;
+      case 's':
+        query.from = std::stoll(optarg);
+        break;
+      case 'e':
+        query.to = std::stoll(optarg);
+        break;
+      case 'f':
+        format = optarg;
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      case 'j':
+        threads = std::max(1, std::stoi(optarg));
+        break;
+      case 'F':
+        follow_mode = true;
+        break;
+      default:
+        usage(argv[0]);
+        return c == 'h' ? 0 : 1;
+    }
+  }
+  std::vector<std::string> files(argv + optind, argv + argc);
+  if (files.empty() || (format != "csv" && format != "binary") || (follow_mode && files.size() != 1)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::ofstream ofs;
+  if (!output.empty()) {
+    ofs.open(output, format == "binary" ? std::ios::binary : std::ios::out);
+    if (!ofs) {
+      std::cerr << "Can not open " << output << std::endl;
+      return 1;
+    }
+  }
+  std::ostream& os = output.empty() ? std::cout : ofs;
+  os.precision(std::numeric_limits<double>::max_digits10);
+
+  if (follow_mode) {
+    os << "time,series,value\n";
+    follow(files.front(), query, os, true);
+    return 0;
+  }
+
+  // Chunks are parsed in parallel and their rows written out in file order as soon as
+  // all earlier chunks are done. Workers stay within `window` chunks of the output, so
+  // that only those are held in memory. Values messages of schema encoded files may
+  // depend on a schema from an earlier chunk of the same file, so the last schema of
+  // each chunk is published before the chunk is parsed.
+  auto chunks = make_chunks(files, 64 << 20);
+  const size_t window = 2 * static_cast<size_t>(threads);
+  std::vector<std::vector<Row>> results(chunks.size());
+  std::vector<bool> done(chunks.size(), false);
+  std::vector<bool> scanned(chunks.size(), false);
+  std::vector<std::string> schemas(chunks.size());
+  size_t written = 0;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<size_t> next{ 0 };
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < std::min<size_t>(threads, chunks.size()); ++t) {
+    workers.emplace_back([&] {
+      for (size_t i = next++; i < chunks.size(); i = next++) {
+        {
+          std::unique_lock<std::mutex> lk(mutex);
+          cv.wait(lk, [&] { return i < written + window; });
+        }
+        std::vector<Row> rows;
+        if (chunks[i].time_series) {
+          read_time_series(chunks[i].file, query, rows);
+        } else {
+          auto text = read_range(chunks[i].file, chunks[i].begin, chunks[i].end);
+          {
+            std::lock_guard<std::mutex> lk(mutex);
+            schemas[i] = last_schema(text);
+            scanned[i] = true;
+          }
+          cv.notify_all();
+          SchemaReader schema(query, [&, i] {
+            std::string found;
+            std::unique_lock<std::mutex> lk(mutex);
+            cv.wait(lk, [&] {
+              for (size_t k = i; k-- > 0 && chunks[k].file == chunks[i].file;) {
+                if (!scanned[k])
+                  return false;
+                if (!schemas[k].empty()) {
+                  found = schemas[k];
+                  break;
+                }
+              }
+              return true;
+            });
+            return found;
+          });
+          parse_lines(text, query, schema, rows);
+        }
+        {
+          std::lock_guard<std::mutex> lk(mutex);
+          results[i] = std::move(rows);
+          done[i] = true;
+        }
+        cv.notify_all();
+      }
+    });
+  }
+
+  Columns columns;
+  if (format == "csv")
+    os << "time,series,value\n";
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    std::vector<Row> rows;
+    {
+      std::unique_lock<std::mutex> lk(mutex);
+      cv.wait(lk, [&] { return done[i]; });
+      rows.swap(results[i]);
+      written = i + 1;
+    }
+    cv.notify_all();
+    if (format == "csv")
+      write_csv(os, rows);
+    else
+      add_columns(columns, rows);
+  }
+  for (auto& w : workers)
+    w.join();
+
+  if (format == "binary") {
+    sort_columns(columns);
+    write_binary(os, columns);
+  }
+  return 0;
+}
@@ -0,0 +1,297 @@
+/**
+ * @file opmon_replay.cpp
+ *
+ * Re-publish recorded fileOpmonService output through any OpmonService, at
+ * the recorded pace, N times faster or as fast as possible, optionally as
+ * several simulated applications at once, and report the throughput and the
+ * publish latency of the service.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/InfoCollector.hpp"
+#include "opmonlib/InfoManager.hpp"
+#include "opmonlib/OpmonService.hpp"
+#include "opmonlib/SchemaCodec.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace dunedaq::opmonlib;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Record
+{
+  nlohmann::json snapshot;
+  int64_t time;  ///< Latest "__time" in the snapshot, or of the snapshot before for messages without any
+  size_t bytes;  ///< Size of the recorded line
+};
+
+struct Result
+{
+  std::vector<double> latencies_us;
+  double max_lag_ms = 0.;
+  size_t bytes = 0;
+  bool failed = false;
+};
+
+int64_t
+latest_time(const nlohmann::json& j)
+{
+  int64_t latest = 0;
+  if (j.is_object()) {
+    for (auto& [key, value] : j.items()) {
+      if (key == InfoCollector::s_time_tag && value.is_number())
+        latest = std::max(latest, value.get<int64_t>());
+      else
+        latest = std::max(latest, latest_time(value));
+    }
+  }
+  return latest;
+}
+
+void
+shift_times(nlohmann::json& j, int64_t offset)
+{
+  if (!j.is_object())
+    return;
+  for (auto& [key, value] : j.items()) {
+    if (key == InfoCollector::s_time_tag && value.is_number())
+      value = value.get<int64_t>() + offset;
+    else
+      shift_times(value, offset);
+  }
+}
+
+// Present the snapshot as coming from application `instance`, by suffixing the names directly under "__parent"
+void
+rename_instance(nlohmann::json& j, int instance)
+{
+  auto root = j.find(InfoManager::s_parent_tag);
+  if (root == j.end() || !root->is_object())
+    return;
+  nlohmann::json renamed = nlohmann::json::object();
+  for (auto& [name, node] : root->items())
+    renamed[name + '-' + std::to_string(instance)] = std::move(node);
+  *root = std::move(renamed);
+}
+
+std::vector<Record>
+load(const std::vector<std::string>& files)
+{
+  std::vector<Record> records;
+  for (auto& f : files) {
+    std::ifstream is(f);
+    if (!is) {
+      std::cerr << "Can not open " << f << std::endl;
+      continue;
+    }
+    SchemaDecoder decoder; // Plain snapshots pass through unchanged
+    int64_t previous_time = 0;
+    std::string line;
+    while (std::getline(is, line)) {
+      if (line.empty())
+        continue;
+      nlohmann::json snapshot;
+      try {
+        if (!decoder.decode(nlohmann::json::parse(line), snapshot))
+          continue;
+      } catch (const nlohmann::json::exception& e) {
+        std::cerr << "Skipping malformed line in " << f << ": " << e.what() << std::endl;
+        continue;
+      }
+      auto time = latest_time(snapshot);
+      time = time == 0 ? previous_time : time;
+      previous_time = time;
+      records.push_back({ std::move(snapshot), time, line.size() });
+    }
+  }
+  // Files of several applications are interleaved by time
+  std::stable_sort(records.begin(), records.end(), [](const Record& a, const Record& b) { return a.time < b.time; });
+  return records;
+}
+
+double
+percentile(std::vector<double>& v, double p)
+{
+  if (v.empty())
+    return 0.;
+  auto n = static_cast<size_t>(p * static_cast<double>(v.size() - 1));
+  std::nth_element(v.begin(), v.begin() + n, v.end());
+  return v[n];
+}
+
+void
+usage(const char* name)
+{
+  std::cerr << "Usage: " << name << " [options] -u URI file...\n"
+            << "  -u, --uri URI        service to publish to, as given to InfoManager; a %d in it is\n"
+            << "                       replaced by the instance number\n"
+            << "  -s, --speed X        1 (default) replays at the recorded pace, X times faster otherwise,\n"
+            << "                       0 as fast as possible\n"
+            << "  -n, --instances N    number of simulated applications, each with its own service (default 1)\n"
+            << "  -l, --loops N        replay the files N times (default 1)\n"
+            << "  -r, --retime         shift recorded times so that the replay starts now\n"
+            << "  -h, --help           show this message\n";
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  std::string uri;
+  double speed = 1.;
+  int instances = 1;
+  int loops = 1;
+  bool retime = false;
+
+  static const option long_options[] = { { "uri", required_argument, nullptr, 'u' },
+                                         { "speed", required_argument, nullptr, 's' },
+                                         { "instances", required_argument, nullptr, 'n' },
+                                         { "loops", required_argument, nullptr, 'l' },
+                                         { "retime", no_argument, nullptr, 'r' },
+                                         { "help", no_argument, nullptr, 'h' },
+                                         { nullptr, 0, nullptr, 0 } };
+  int c;
+  while ((c = getopt_long(argc, argv, "u:s:n:l:rh", long_options, nullptr)) != -1) {
+    switch (c) {
+      case 'u':
+        uri = optarg;
+        break;
+      case 's':
+        speed = std::stod(optarg);
+        break;
+      case 'n':
+        instances = std::max(1, std::stoi(optarg));
+        break;
+      case 'l':
+        loops = std::max(1, std::stoi(optarg));
+        break;
+      case 'r':
+        retime = true;
+        break;
+      default:
+        usage(argv[0]);
+        return c == 'h' ? 0 : 1;
+    }
+  }
+  std::vector<std::string> files(argv + optind, argv + argc);
+  if (uri.empty() || files.empty() || speed < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  auto records = load(files);
+  if (records.empty()) {
+    std::cerr << "Nothing to replay" << std::endl;
+    return 1;
+  }
+  int64_t first_time = records.front().time;
+  int64_t last_time = records.back().time;
+  int64_t loop_span = last_time - first_time + 1; // Recorded seconds covered by one loop
+  auto loop_duration = std::chrono::duration<double>(static_cast<double>(loop_span) / (speed > 0 ? speed : 1.));
+
+  // One service per simulated application, created before the clock starts
+  std::vector<std::shared_ptr<OpmonService>> services;
+  for (int i = 0; i < instances; ++i) {
+    auto instance_uri = uri;
+    auto pos = instance_uri.find("%d");
+    if (pos != std::string::npos)
+      instance_uri.replace(pos, 2, std::to_string(i));
+    try {
+      services.push_back(makeOpmonService(instance_uri));
+    } catch (const OpmonServiceCreationFailed& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  std::cout << "Replaying " << records.size() << " snapshots spanning " << last_time - first_time << " s to "
+            << instances << " x " << uri << std::endl;
+
+  std::vector<Result> results(instances);
+  std::vector<std::thread> threads;
+  auto start = Clock::now();
+  int64_t now_offset = std::time(nullptr) - first_time;
+  for (int i = 0; i < instances; ++i) {
+    threads.emplace_back([&, i] {
+      auto& result = results[i];
+      result.latencies_us.reserve(records.size() * loops);
+      for (int loop = 0; loop < loops; ++loop) {
+        auto loop_start = start + std::chrono::duration_cast<Clock::duration>(loop_duration * loop);
+        for (auto& r : records) {
+          auto j = r.snapshot;
+          if (instances > 1)
+            rename_instance(j, i);
+          if (retime)
+            shift_times(j, now_offset + loop_span * loop);
+
+          if (speed > 0) {
+            auto due = loop_start + std::chrono::duration_cast<Clock::duration>(
+                                      std::chrono::duration<double>((r.time - first_time) / speed));
+            std::this_thread::sleep_until(due);
+            result.max_lag_ms =
+              std::max(result.max_lag_ms, std::chrono::duration<double, std::milli>(Clock::now() - due).count());
+          }
+
+          auto t0 = Clock::now();
+          try {
+            services[i]->publish(std::move(j));
+          } catch (const std::exception& e) {
+            if (!result.failed)
+              std::cerr << "Instance " << i << ": publish failed: " << e.what() << std::endl;
+            result.failed = true;
+          }
+          result.latencies_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - t0).count());
+          result.bytes += r.bytes;
+        }
+      }
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::vector<double> latencies;
+  size_t bytes = 0;
+  double max_lag_ms = 0.;
+  for (auto& r : results) {
+    latencies.insert(latencies.end(), r.latencies_us.begin(), r.latencies_us.end());
+    bytes += r.bytes;
+    max_lag_ms = std::max(max_lag_ms, r.max_lag_ms);
+  }
+  auto published = latencies.size();
+  double mean = 0.;
+  for (auto l : latencies)
+    mean += l / static_cast<double>(published);
+
+  std::cout << std::fixed << std::setprecision(3) << "Published " << published << " snapshots in " << elapsed
+            << std::setprecision(1) << " s: " << published / elapsed << " snapshots/s, " << bytes / elapsed / 1e6
+            << " MB/s of recorded JSON\n"
+            << "publish latency (us): mean " << mean << ", p50 " << percentile(latencies, 0.5) << ", p90 "
+            << percentile(latencies, 0.9) << ", p99 " << percentile(latencies, 0.99) << ", max "
+            << percentile(latencies, 1.) << "\n";
+  if (speed > 0)
+    std::cout << "max lag behind schedule: " << max_lag_ms << " ms\n";
+  return std::any_of(results.begin(), results.end(), [](const Result& r) { return r.failed; }) ? 1 : 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file Accounting.hpp
+ *
+ * Allocation and write syscall counters for tests and benchmarks. They only
+ * count when a program opts in by including opmonlib/AccountingHooks.hpp in
+ * one of its translation units; otherwise they stay at zero and
+ * enabled() is false.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_ACCOUNTING_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_ACCOUNTING_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace dunedaq::opmonlib::accounting {
+
+struct Counts
+{
+  uint64_t allocations = 0;     // NOLINT(build/unsigned)
+  uint64_t deallocations = 0;   // NOLINT(build/unsigned)
+  uint64_t allocated_bytes = 0; // NOLINT(build/unsigned)
+  uint64_t writes = 0;          // NOLINT(build/unsigned) Calls to write(2) and writev(2)
+  uint64_t written_bytes = 0;   // NOLINT(build/unsigned)
+
+  Counts& operator+=(const Counts& other)
+  {
+    allocations += other.allocations;
+    deallocations += other.deallocations;
+    allocated_bytes += other.allocated_bytes;
+    writes += other.writes;
+    written_bytes += other.written_bytes;
+    return *this;
+  }
+
+  Counts operator-(const Counts& other) const
+  {
+    return { allocations - other.allocations,
+             deallocations - other.deallocations,
+             allocated_bytes - other.allocated_bytes,
+             writes - other.writes,
+             written_bytes - other.written_bytes };
+  }
+};
+
+namespace detail {
+inline std::atomic<bool> enabled{ false };
+inline thread_local Counts thread_counts;
+inline std::atomic<uint64_t> process_allocations{ 0 };     // NOLINT(build/unsigned)
+inline std::atomic<uint64_t> process_deallocations{ 0 };   // NOLINT(build/unsigned)
+inline std::atomic<uint64_t> process_allocated_bytes{ 0 }; // NOLINT(build/unsigned)
+inline std::atomic<uint64_t> process_writes{ 0 };          // NOLINT(build/unsigned)
+inline std::atomic<uint64_t> process_written_bytes{ 0 };   // NOLINT(build/unsigned)
+} // namespace detail
+
+// Whether the hooks are linked into this program
+inline bool
+enabled()
+{
+  return detail::enabled.load(std::memory_order_relaxed);
+}
+
+// Counts of the calling thread since it started
+inline Counts
+thread_counts()
+{
+  return detail::thread_counts;
+}
+
+// Counts of all threads since the program started
+inline Counts
+process_counts()
+{
+  return { detail::process_allocations.load(std::memory_order_relaxed),
+           detail::process_deallocations.load(std::memory_order_relaxed),
+           detail::process_allocated_bytes.load(std::memory_order_relaxed),
+           detail::process_writes.load(std::memory_order_relaxed),
+           detail::process_written_bytes.load(std::memory_order_relaxed) };
+}
+
+// Called by the hooks; nothing in here may allocate
+inline void
+record_allocation(size_t bytes) noexcept
+{
+  ++detail::thread_counts.allocations;
+  detail::thread_counts.allocated_bytes += bytes;
+  detail::process_allocations.fetch_add(1, std::memory_order_relaxed);
+  detail::process_allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+inline void
+record_deallocation() noexcept
+{
+  ++detail::thread_counts.deallocations;
+  detail::process_deallocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void
+record_write(size_t bytes) noexcept
+{
+  ++detail::thread_counts.writes;
+  detail::thread_counts.written_bytes += bytes;
+  detail::process_writes.fetch_add(1, std::memory_order_relaxed);
+  detail::process_written_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+} // namespace dunedaq::opmonlib::accounting
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_ACCOUNTING_HPP_
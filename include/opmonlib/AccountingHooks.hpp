@@ -0,0 +1,148 @@
+/**
+ * @file AccountingHooks.hpp
+ *
+ * Replaces the global operator new/delete and interposes write(2)/writev(2)
+ * so that the counters of opmonlib/Accounting.hpp count. Include it in
+ * exactly one translation unit of a test or benchmark program, never in a
+ * library.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_ACCOUNTINGHOOKS_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_ACCOUNTINGHOOKS_HPP_
+
+#include "opmonlib/Accounting.hpp"
+
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <new>
+
+namespace dunedaq::opmonlib::accounting::detail {
+// Internal linkage, so that it is initialised in the one translation unit including this header
+static const bool s_hooks_installed = (enabled.store(true), true);
+
+inline void*
+counted_alloc(std::size_t size, std::size_t alignment = 0)
+{
+  record_allocation(size);
+  if (alignment > alignof(std::max_align_t))
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+// GCC can not tell that counted_alloc is malloc underneath
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+inline void
+counted_free(void* p) noexcept
+{
+  if (p == nullptr)
+    return;
+  record_deallocation();
+  std::free(p);
+}
+#pragma GCC diagnostic pop
+} // namespace dunedaq::opmonlib::accounting::detail
+
+// NOLINTBEGIN
+void*
+operator new(std::size_t size)
+{
+  if (void* p = dunedaq::opmonlib::accounting::detail::counted_alloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+void*
+operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+void*
+operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  return dunedaq::opmonlib::accounting::detail::counted_alloc(size);
+}
+void*
+operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  return dunedaq::opmonlib::accounting::detail::counted_alloc(size);
+}
+void*
+operator new(std::size_t size, std::align_val_t al)
+{
+  if (void* p = dunedaq::opmonlib::accounting::detail::counted_alloc(size, static_cast<std::size_t>(al)))
+    return p;
+  throw std::bad_alloc();
+}
+void*
+operator new[](std::size_t size, std::align_val_t al)
+{
+  return operator new(size, al);
+}
+void
+operator delete(void* p) noexcept
+{
+  dunedaq::opmonlib::accounting::detail::counted_free(p);
+}
+void
+operator delete[](void* p) noexcept
+{
+  dunedaq::opmonlib::accounting::detail::counted_free(p);
+}
+void
+operator delete(void* p, std::size_t) noexcept
+{
+  dunedaq::opmonlib::accounting::detail::counted_free(p);
+}
+void
+operator delete[](void* p, std::size_t) noexcept
+{
+  dunedaq::opmonlib::accounting::detail::counted_free(p);
+}
+void
+operator delete(void* p, std::align_val_t) noexcept
+{
+  dunedaq::opmonlib::accounting::detail::counted_free(p);
+}
+void
+operator delete[](void* p, std::align_val_t) noexcept
+{
+  dunedaq::opmonlib::accounting::detail::counted_free(p);
+}
+void
+operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+  dunedaq::opmonlib::accounting::detail::counted_free(p);
+}
+void
+operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+  dunedaq::opmonlib::accounting::detail::counted_free(p);
+}
+
+// Interposed on the C library, so the writes of std::ofstream and friends are counted too
+extern "C" ssize_t
+write(int fd, const void* buf, size_t count)
+{
+  dunedaq::opmonlib::accounting::record_write(count);
+  return syscall(SYS_write, fd, buf, count);
+}
+
+extern "C" ssize_t
+writev(int fd, const struct iovec* iov, int iovcnt)
+{
+  size_t bytes = 0;
+  for (int i = 0; i < iovcnt; ++i)
+    bytes += iov[i].iov_len;
+  dunedaq::opmonlib::accounting::record_write(bytes);
+  return syscall(SYS_writev, fd, iov, iovcnt);
+}
+// NOLINTEND
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_ACCOUNTINGHOOKS_HPP_
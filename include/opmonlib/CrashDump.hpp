@@ -0,0 +1,74 @@
+/**
+ * @file CrashDump.hpp
+ *
+ * Preallocated history of the most recent serialized snapshots, written out
+ * by an async-signal-safe handler when the process receives a fatal signal.
+ * The handler runs on an alternate signal stack, so that stack overflows are
+ * dumped too, on threads that have one (see CrashHistory::prepare_thread()).
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_CRASHDUMP_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_CRASHDUMP_HPP_
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace dunedaq::opmonlib {
+
+class CrashHistory
+{
+public:
+  CrashHistory(size_t num_snapshots, size_t max_bytes);
+  ~CrashHistory();
+  CrashHistory(const CrashHistory&) = delete;            ///< CrashHistory is not copy-constructible
+  CrashHistory& operator=(const CrashHistory&) = delete; ///< CrashHistory is not copy-assignable
+
+  // Copy a serialized snapshot into the next slot; snapshots larger than a slot are truncated
+  void record(const std::string& snapshot);
+  // Serialize a snapshot straight into the next slot, without building the text elsewhere
+  void record(const nlohmann::json& snapshot);
+
+  // Install handlers for SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT appending the
+  // history, oldest first and one snapshot per line, to `filename`. Only one
+  // CrashHistory can be installed at a time, a warning is issued for the others; the
+  // handlers are removed on destruction. The calling thread is prepared as by prepare_thread().
+  void install_handler(const std::string& filename);
+
+  // Give the calling thread an alternate signal stack, if it has none, for the
+  // handlers to run on after a stack overflow. It is removed when the thread exits.
+  static void prepare_thread();
+
+  // Write the history to an open file descriptor; async-signal-safe
+  void write_to(int fd) const;
+
+private:
+  class SlotBuffer;
+
+  static void handle_signal(int sig);
+  void uninstall_handler();
+
+  size_t m_num_slots;
+  size_t m_slot_size;
+  std::unique_ptr<char[]> m_buffer;
+  std::unique_ptr<std::atomic<size_t>[]> m_lengths;
+  std::unique_ptr<SlotBuffer> m_slot_buffer;
+  std::ostream m_stream; ///< Writes to m_slot_buffer
+  size_t m_next = 0;
+  char m_filename[4096] = {};
+  bool m_installed = false;
+
+  static std::atomic<CrashHistory*> s_installed;
+};
+
+} // namespace dunedaq::opmonlib
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_CRASHDUMP_HPP_
@@ -0,0 +1,72 @@
+/**
+ * @file DeferredOpmonService.hpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_DEFERREDOPMONSERVICE_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_DEFERREDOPMONSERVICE_HPP_
+
+#include "opmonlib/OpmonService.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace dunedaq::opmonlib {
+
+/**
+ * @brief Stand-in for a service that is created on a background thread
+ *
+ * Creating a service may open files, connect or load a plugin, none of which
+ * is needed until something is published. The real service is created by
+ * makeOpmonService() on a background thread, started explicitly or by the
+ * first publication. Until it exists, snapshots and events are kept in memory,
+ * up to `max_buffered` (oldest dropped first), and are then handed to it in
+ * order. If it can not be created the error is reported and everything
+ * published to this service is dropped.
+ */
+class DeferredOpmonService : public OpmonService
+{
+public:
+  explicit DeferredOpmonService(std::string service, size_t max_buffered = 100);
+  ~DeferredOpmonService();
+
+  // Start creating the service, if not already started
+  void start_construction();
+  // Wait until the service has been created; false if it could not be
+  bool wait();
+
+  void publish(nlohmann::json j) override;
+  void publish_event(nlohmann::json j) override;
+
+  // Messages dropped because the buffer was full or the service could not be created
+  size_t get_num_dropped() const;
+
+private:
+  void construct();
+  void forward(bool event, nlohmann::json j);
+
+  const size_t m_max_buffered;
+  std::once_flag m_started;
+  std::thread m_thread;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::shared_ptr<OpmonService> m_service;
+  bool m_done = false;
+  std::deque<std::pair<bool, nlohmann::json>> m_pending; ///< (is an event, message)
+  size_t m_num_dropped = 0;
+};
+
+} // namespace dunedaq::opmonlib
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_DEFERREDOPMONSERVICE_HPP_
@@ -0,0 +1,137 @@
+/**
+ * @file EventChannel.hpp
+ *
+ * Channel for discrete operational events (link down, buffer overflow, ...)
+ * which are forwarded to the OpmonService as soon as they happen instead of
+ * waiting for the next periodic snapshot.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_EVENTCHANNEL_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_EVENTCHANNEL_HPP_
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dunedaq::opmonlib {
+
+enum class EventSeverity
+{
+  kInfo,
+  kWarning,
+  kError
+};
+
+struct OpmonEvent
+{
+  std::string source; ///< Emitting object, e.g. module name
+  std::string type;   ///< Event type, also the key used for coalescing
+  EventSeverity severity = EventSeverity::kInfo;
+  std::string message;
+  int64_t time_ns = 0; ///< Wall clock time of the event
+};
+
+/**
+ * @brief Bounded lock-free multi-producer single-consumer queue of events
+ *
+ * Slots carry sequence numbers, so producers only contend on one atomic
+ * increment. When the queue is full the event is dropped and counted.
+ */
+class EventQueue
+{
+public:
+  explicit EventQueue(size_t capacity = 1024);
+  EventQueue(const EventQueue&) = delete;            ///< EventQueue is not copy-constructible
+  EventQueue& operator=(const EventQueue&) = delete; ///< EventQueue is not copy-assignable
+
+  // Process-wide queue drained by the InfoManager
+  static EventQueue& get();
+
+  // Any thread
+  bool push(OpmonEvent&& e);
+
+  // Become the consumer; false if another thread already is. Releasing hands the
+  // queue over to the next thread claiming it.
+  bool claim_consumer() { return !m_consumer_claimed.exchange(true, std::memory_order_acquire); }
+  void release_consumer() { m_consumer_claimed.store(false, std::memory_order_release); }
+
+  // Consumer thread only
+  bool pop(OpmonEvent& e);
+  void wait(std::chrono::milliseconds timeout);
+
+  uint64_t get_num_dropped() { return m_dropped.exchange(0, std::memory_order_relaxed); } // NOLINT(build/unsigned)
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    OpmonEvent event;
+  };
+
+  std::unique_ptr<Cell[]> m_cells;
+  size_t m_mask;
+  alignas(64) std::atomic<size_t> m_enqueue_pos{ 0 };
+  alignas(64) size_t m_dequeue_pos = 0;
+  std::atomic<bool> m_consumer_claimed{ false };
+  std::atomic<uint64_t> m_dropped{ 0 }; // NOLINT(build/unsigned)
+  std::mutex m_wait_mutex;
+  std::condition_variable m_wait_cv;
+};
+
+// Push an event to the process-wide queue; returns false if it had to be dropped
+bool
+emit_event(std::string source, std::string type, std::string message, EventSeverity severity = EventSeverity::kWarning);
+
+/**
+ * @brief Coalescing and rate limiting of drained events
+ *
+ * The first event of a given (source, type) is let through immediately;
+ * repeats within the coalescing window are counted and forwarded once when
+ * the window closes. A token bucket bounds the overall output rate, events
+ * beyond it are dropped and their number reported with the next one sent.
+ */
+class EventThrottle
+{
+public:
+  EventThrottle(double rate_hz = 50., double burst = 100., std::chrono::milliseconds window = std::chrono::seconds(1));
+
+  void offer(OpmonEvent&& e, std::vector<nlohmann::json>& out);
+  // Forward the repeats whose window has closed, or all of them if `all`
+  void flush(std::vector<nlohmann::json>& out, bool all = false);
+  void add_dropped(uint64_t n) { m_dropped += n; } // NOLINT(build/unsigned)
+
+private:
+  using clock_t = std::chrono::steady_clock;
+  struct KeyState
+  {
+    clock_t::time_point last_sent;
+    uint64_t suppressed = 0; // NOLINT(build/unsigned)
+    OpmonEvent latest;
+  };
+
+  void send(const OpmonEvent& e, uint64_t count, clock_t::time_point now, std::vector<nlohmann::json>& out); // NOLINT
+
+  double m_rate_hz;
+  double m_burst;
+  std::chrono::milliseconds m_window;
+  double m_tokens;
+  clock_t::time_point m_last_refill;
+  uint64_t m_dropped = 0; // NOLINT(build/unsigned)
+  std::map<std::string, KeyState> m_keys;
+};
+
+} // namespace dunedaq::opmonlib
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_EVENTCHANNEL_HPP_
@@ -0,0 +1,70 @@
+/**
+ * @file GatherContext.hpp
+ *
+ * Settings shared by all the InfoCollectors of one gather, consulted each
+ * time a child provider is gathered through InfoCollector::add(name, provider, level).
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_GATHERCONTEXT_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_GATHERCONTEXT_HPP_
+
+#include "opmonlib/PathFilter.hpp"
+
+#include <algorithm>
+#include <map>
+#include <string>
+
+namespace dunedaq::opmonlib {
+
+class GatherContext
+{
+public:
+  // Level to gather the node at `path` with, given the level its parent passed down
+  int level_for(const std::string& path, int level) const
+  {
+    auto it = m_level_overrides.find(path);
+    return it == m_level_overrides.end() ? level : it->second;
+  }
+
+  bool overrides_level(const std::string& path) const { return m_level_overrides.count(path) > 0; }
+  void set_level(const std::string& path, int level) { m_level_overrides[path] = level; }
+  void clear_level(const std::string& path) { m_level_overrides.erase(path); }
+  const std::map<std::string, int>& get_level_overrides() const { return m_level_overrides; }
+
+  // Whether the node at `path` is to be gathered at all
+  PathFilter::Decision filter(const std::string& path) const
+  {
+    auto decision = m_filter.empty() ? PathFilter::Decision::kAccept : m_filter.check(path);
+    if (m_prefix.empty() || decision == PathFilter::Decision::kPrune)
+      return decision;
+    return std::min(decision, check_prefix(path));
+  }
+  PathFilter& get_filter() { return m_filter; }
+
+  // Restrict the gather to the subtree at `prefix`, on top of the filter
+  void set_prefix(const std::string& prefix) { m_prefix = prefix; }
+
+private:
+  PathFilter::Decision check_prefix(const std::string& path) const
+  {
+    auto n = std::min(path.size(), m_prefix.size());
+    if (path.compare(0, n, m_prefix, 0, n) != 0)
+      return PathFilter::Decision::kPrune;
+    if (path.size() >= m_prefix.size())
+      return path.size() == m_prefix.size() || path[n] == '.' ? PathFilter::Decision::kAccept
+                                                                : PathFilter::Decision::kPrune;
+    return m_prefix[n] == '.' ? PathFilter::Decision::kDescend : PathFilter::Decision::kPrune;
+  }
+
+  std::map<std::string, int> m_level_overrides;
+  PathFilter m_filter;
+  std::string m_prefix;
+};
+
+} // namespace dunedaq::opmonlib
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_GATHERCONTEXT_HPP_
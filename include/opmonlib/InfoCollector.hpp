@@ -9,25 +9,54 @@
 #ifndef OPMONLIB_INCLUDE_OPMONLIB_INFOCOLLECTOR_HPP_
 #define OPMONLIB_INCLUDE_OPMONLIB_INFOCOLLECTOR_HPP_
 
+#include "opmonlib/GatherContext.hpp"
+#include "opmonlib/LabeledFamily.hpp"
+#include "opmonlib/LatencyProbe.hpp"
+#include "opmonlib/Levels.hpp"
+
 #include <nlohmann/json.hpp>
 
 #include <ctime>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace dunedaq::opmonlib {
 
+// True for the info structures generated from schema, which carry their type name
+template<typename I, typename = void>
+struct is_info_struct : std::false_type
+{};
+template<typename I>
+struct is_info_struct<I, std::void_t<decltype(std::decay_t<I>::info_type)>> : std::true_type
+{};
+
+class InfoProvider;
+class Counter;
+class Gauge;
+class Histogram;
+
 class InfoCollector
 {
 
 public:
+  InfoCollector() = default;
+  // Collector for the node at `path`, sharing the settings of the gather it belongs to
+  InfoCollector(std::shared_ptr<const GatherContext> context, std::string path)
+    : m_context(std::move(context))
+    , m_path(std::move(path))
+  {}
+
   static inline constexpr char s_time_tag[]{ "__time" };
   static inline constexpr char s_data_tag[]{ "__data" };
   static inline constexpr char s_children_tag[]{ "__children" };
   static inline constexpr char s_prop_tag[]{ "__properties" }; // Rename infoblocks?
 
   // Templated method to grab info blocks
-  template<typename I>
+  template<typename I, typename = std::enable_if_t<is_info_struct<I>::value>>
   void add(I&& infoclass)
   {
     nlohmann::json j_infoblock;
@@ -35,18 +64,99 @@ public:
     j_infoblock[s_data_tag] = infoclass;
 
     m_infos[s_prop_tag][infoclass.info_type] = j_infoblock;
+    added(s_prop_tag, infoclass.info_type);
+  }
+
+  // Merge the per-thread histograms of a latency probe into a summary block
+  void add(const LatencyProbe& probe)
+  {
+    auto stats = probe.get_stats();
+    nlohmann::json j_infoblock;
+    j_infoblock[s_time_tag] = std::time(nullptr);
+    j_infoblock[s_data_tag] = { { "count", stats.count },   { "mean_ns", stats.mean_ns }, { "min_ns", stats.min_ns },
+                                { "max_ns", stats.max_ns }, { "p50_ns", stats.p50_ns },   { "p90_ns", stats.p90_ns },
+                                { "p99_ns", stats.p99_ns } };
+
+    m_infos[s_prop_tag][probe.get_name()] = j_infoblock;
+    added(s_prop_tag, probe.get_name());
+  }
+
+  // Add a labeled family compactly: labels and field names once, one array of values per field
+  template<typename T>
+  void add(const LabeledFamily<T>& family)
+  {
+    nlohmann::json j_data;
+    j_data[family.get_label_name()] = family.get_labels();
+    const auto& fields = family.get_field_names();
+    for (size_t f = 0; f < fields.size(); ++f)
+      j_data[fields[f]] = std::vector<T>(family.column(f), family.column(f) + family.size());
+
+    nlohmann::json j_infoblock;
+    j_infoblock[s_time_tag] = std::time(nullptr);
+    j_infoblock[s_data_tag] = std::move(j_data);
+
+    m_infos[s_prop_tag][family.get_info_type()] = j_infoblock;
+    added(s_prop_tag, family.get_info_type());
   }
 
+  // Metrics from opmonlib/Metrics.hpp, each as an info block named after the metric
+  void add(const Counter& counter);
+  void add(const Gauge& gauge);
+  void add(const Histogram& histogram);
+
+  // Any of the adds above or below, compiled out if level L is above OPMONLIB_MAX_LEVEL (see Levels.hpp).
+  // Whether L is wanted at the level of the current gather is still up to the caller. The level
+  // is recorded, so that a single gather can serve services wanting less detail (see get_leveled()).
+  template<int L, typename... Args>
+  void add(Args&&... args)
+  {
+    if constexpr (level_enabled(L)) {
+      m_adding_level = L;
+      add(std::forward<Args>(args)...);
+      m_adding_level = 0;
+    }
+  }
+
+  // Location in the collected infos, and level, of what was added with add<L>() and L > 0,
+  // here or in the children. Nothing is recorded below a node whose level is overridden,
+  // since it is gathered at that level whatever the level of the gather.
+  using Leveled = std::vector<std::pair<nlohmann::json::json_pointer, int>>;
+  const Leveled& get_leveled() const { return m_leveled; }
+
   // Puny getter
   const nlohmann::json& get_collected_infos() { return m_infos; }
 
-  // Method to construct hierarchical info
-  void add(std::string name, InfoCollector& ic) { m_infos[s_children_tag][name] = ic.get_collected_infos(); }
+  // Method to construct hierarchical info. Path filters are applied to a child
+  // filled by hand once it is added, unless it was made by child().
+  void add(std::string name, InfoCollector& ic);
+  // Gather a child provider under `name`, applying the settings of the gather
+  // (e.g. per-path level overrides). Preferred over filling a child collector by hand.
+  void add(std::string name, InfoProvider& provider, int level);
+  // For children filled by hand: a collector for the child `name`, sharing the
+  // settings of the gather, and the level to fill it at given the level of this node
+  InfoCollector child(const std::string& name) const;
+  int level_for(const std::string& name, int level) const;
   // Method to check it there is any info stored
   bool is_empty() { return m_infos.empty(); }
 
+  const std::string& get_path() const { return m_path; }
+
 private:
+  void added(const char* tag, const std::string& name)
+  {
+    if (m_adding_level > 0 && !m_level_overridden)
+      m_leveled.emplace_back(nlohmann::json::json_pointer() / tag / name, m_adding_level);
+  }
+  void merge_leveled(const std::string& name, const Leveled& child);
+  std::string child_path(const std::string& name) const { return m_path.empty() ? name : m_path + '.' + name; }
+  static void filter_children(const GatherContext& context, const std::string& path, nlohmann::json& infos);
+
   nlohmann::json m_infos;
+  std::shared_ptr<const GatherContext> m_context;
+  std::string m_path;
+  int m_adding_level = 0;
+  bool m_level_overridden = false;
+  Leveled m_leveled;
 };
 
 } // namespace dunedaq::opmonlib
@@ -9,38 +9,200 @@
 #ifndef OPMONLIB_INCLUDE_OPMONLIB_INFOMANAGER_HPP_
 #define OPMONLIB_INCLUDE_OPMONLIB_INFOMANAGER_HPP_
 
+#include "opmonlib/Accounting.hpp"
+#include "opmonlib/CrashDump.hpp"
+#include "opmonlib/DeferredOpmonService.hpp"
+#include "opmonlib/EventChannel.hpp"
+#include "opmonlib/GatherContext.hpp"
+#include "opmonlib/InfoCollector.hpp"
 #include "opmonlib/InfoProvider.hpp"
 #include "opmonlib/OpmonService.hpp"
+#include "opmonlib/RuleEngine.hpp"
 
 #include <nlohmann/json.hpp>
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 namespace dunedaq::opmonlib {
 
 class InfoManager
 {
 public:
+  // A gauge is evaluated lazily, only when its level is gathered
+  using GaugeFunction = std::function<nlohmann::json()>;
+  using GaugeId = size_t;
+
   static inline constexpr char s_parent_tag[]{ "__parent" }; // Call it "top"?
+  static inline constexpr char s_event_tag[]{ "__event" };
+  static inline constexpr char s_burst_tag[]{ "__burst" };
 
+  // With "deferred" among the query parameters of `service` (e.g. "file:///tmp/opmon.json?deferred"),
+  // the service is created on a background thread at start() or at the first publication
+  // rather than here, and what is published in the meantime is buffered (see DeferredOpmonService)
   explicit InfoManager(std::string service); // Constructor
   explicit InfoManager(dunedaq::opmonlib::OpmonService& service);
+  ~InfoManager();
   void publish_info(int level);
   nlohmann::json gather_info(int level);
+  // Gather only the subtree at `prefix` (dot separated, empty for everything)
+  nlohmann::json gather_info(int level, const std::string& prefix);
   void set_provider(opmonlib::InfoProvider& p);
+  // Location in a gathered snapshot of info block `info_type` of the node at `path`
+  static nlohmann::json::json_pointer info_block_pointer(const std::string& path, const std::string& info_type);
+  // Register a gauge publishing as field `field` of info block `info_type` of the node
+  // at `path` (dot separated, starting below the parent tag, e.g. "partition.module")
+  GaugeId add_gauge(const std::string& path,
+                    const std::string& info_type,
+                    const std::string& field,
+                    GaugeFunction gauge,
+                    int level = 0);
+  // Unregister a gauge. Once this returns the function is not running and will not be called again,
+  // so objects it refers to can be destroyed. Returns false if there was no such gauge.
+  bool remove_gauge(GaugeId id);
+  // Add threshold rules (see RuleEngine), evaluated on every published snapshot
+  void add_rules(const nlohmann::json& config);
   void start(uint32_t interval_sec, uint32_t level); // NOLINT(build/unsigned)
   void stop();
+  // Change the publication level or interval of a running InfoManager; takes effect at the next deadline
+  void set_level(uint32_t level);           // NOLINT(build/unsigned)
+  void set_interval(uint32_t interval_sec); // NOLINT(build/unsigned)
+  // Gather the subtree at `path` with a different level than its parent passes down
+  void set_level(const std::string& path, int level);
+  void clear_level(const std::string& path);
+  // Only gather the subtrees matching `include` (all if empty), minus those matching `exclude`.
+  // Patterns are dot separated paths, "*" matching any one name. Filters can also be
+  // given in the service URI, e.g. "file:///tmp/opmon.json?include=partition.*.trb&exclude=partition.x"
+  void set_path_filter(const std::vector<std::string>& include, const std::vector<std::string>& exclude);
+  // Also send the subtree at `prefix`, at min(level, max_level), to `service` whenever the
+  // publication level is at least `min_level`. Each publication gathers once, at the highest
+  // level wanted, and what was added with a higher InfoCollector::add<L>() level, or by a gauge
+  // of a higher level, is removed for routes wanting less. The service given to the constructor
+  // is the default route, covering all levels and paths unless changed with set_default_route().
+  void add_route(int min_level, int max_level, const std::string& prefix, const std::string& service);
+  void add_route(int min_level, int max_level, const std::string& prefix, std::shared_ptr<OpmonService> service);
+  void set_default_route(int min_level, int max_level, const std::string& prefix);
+  // Accept text commands on a unix datagram socket bound to `path`, e.g.
+  // "level 2", "level partition.module 3", "clear partition.module", "interval 5", "status".
+  // The reply is sent back to the sender if it has bound an address. The socket is only
+  // accessible to the owner of the process; a stale socket at `path` is replaced, but any
+  // other file is not. Only one control socket can be open.
+  void open_control_socket(const std::string& path);
+  std::string handle_command(const std::string& command);
+  // Rate limiting and coalescing of events; takes effect at the next start()
+  void set_event_limits(double rate_hz, double burst, std::chrono::milliseconds coalescing_window);
+  // Keep `depth` worth of unpublished snapshots gathered every `period`. A burst, triggered
+  // explicitly or by a raised alarm, publishes that history and then every fast snapshot
+  // for `burst_duration`. Takes effect at the next start().
+  void enable_history(std::chrono::milliseconds period,
+                      std::chrono::seconds depth,
+                      std::chrono::seconds burst_duration);
+  void trigger_burst();
+  void trigger_burst(std::chrono::seconds duration);
+  // Keep the last `num_snapshots` snapshots (published or history) in a preallocated
+  // buffer, written to `filename` if the process receives a fatal signal
+  void enable_crash_dump(const std::string& filename, size_t num_snapshots = 16, size_t max_bytes = 1 << 20);
+
+  // Allocations, writes and duration of the calling thread in the last publish_info(), per phase.
+  // All zero unless the program includes opmonlib/AccountingHooks.hpp.
+  struct PhaseCounts
+  {
+    accounting::Counts gather;
+    accounting::Counts publish;
+    std::chrono::nanoseconds gather_time{ 0 };
+    std::chrono::nanoseconds publish_time{ 0 };   ///< Rules, routing and the services' publish()
+    std::chrono::nanoseconds serialize_time{ 0 }; ///< Part of publish_time serializing for the services
+  };
+  PhaseCounts get_phase_counts() const;
 
 private:
-  void run(uint32_t interval_sec, uint32_t level); // NOLINT(build/unsigned)
+  struct Gauge
+  {
+    GaugeId id;
+    int level;
+    std::string path;
+    nlohmann::json::json_pointer block;
+    std::string field;
+    GaugeFunction function;
+    std::atomic<bool> removed{ false };
+  };
+
+  void sample_gauges(nlohmann::json& j, int level, const GatherContext& context, InfoCollector::Leveled* leveled);
+  struct Route
+  {
+    int min_level;
+    int max_level;
+    std::string prefix;
+    std::shared_ptr<opmonlib::OpmonService> service;
+    std::shared_ptr<std::mutex> lock; ///< Held while publishing to `service`, shared by its routes
+  };
+
+  // A tree gathered once for all the routes of a publication level
+  struct Snapshot
+  {
+    nlohmann::json j; ///< Null if no route wants the level
+    int level = 0;    ///< Publication level
+    int gathered_level = 0;
+    std::string prefix;             ///< Common prefix of the routes
+    InfoCollector::Leveled leveled; ///< Locations in j of what is left out for lower levels
+  };
+
+  static nlohmann::json::json_pointer node_pointer(const std::string& path);
+  nlohmann::json gather_info(int level, const std::string& prefix, InfoCollector::Leveled* leveled);
+  Snapshot gather_snapshot(int level, bool for_rules);
+  nlohmann::json make_view(const Snapshot& s, int level, const std::string& prefix);
+  // Returns the time spent serializing views for services reporting a format
+  std::chrono::nanoseconds route_snapshot(Snapshot s);
+  void check_snapshot(nlohmann::json& j);
+  void record_crash_history(const nlohmann::json& j);
+  void publish_event(nlohmann::json j);
+  void stamp_burst(nlohmann::json& j, bool from_history);
+  void run();
+  void run_events();
+  void run_control();
+  std::shared_ptr<const GatherContext> get_context();
 
   mutable opmonlib::InfoProvider* m_ip = nullptr;
   std::shared_ptr<opmonlib::OpmonService> m_service;
+  std::shared_ptr<DeferredOpmonService> m_deferred_service; ///< m_service, if its creation is deferred
   std::atomic<bool> m_running;
+  std::atomic<uint32_t> m_level{ 0 };        // NOLINT(build/unsigned)
+  std::atomic<uint32_t> m_interval_sec{ 0 }; // NOLINT(build/unsigned)
   std::thread m_thread;
+  std::thread m_event_thread;
+  std::thread m_control_thread;
+  int m_control_fd = -1;
+  std::string m_control_path;
+  std::mutex m_context_mutex;
+  std::shared_ptr<const GatherContext> m_context = std::make_shared<GatherContext>();
+  std::mutex m_service_mutex; ///< Guards the routing table and the crash history, not publication
+  std::vector<Route> m_routes;
+  std::mutex m_event_throttle_mutex;
+  EventThrottle m_event_throttle; ///< Limits for the next start(); the event thread works on a copy
+  RuleEngine m_rules;
+  std::mutex m_run_mutex;
+  std::condition_variable m_run_cv;
+  std::chrono::milliseconds m_history_period{ 0 };
+  size_t m_history_depth = 0;
+  std::chrono::seconds m_burst_duration{ 0 };
+  std::atomic<int64_t> m_burst_request_ms{ 0 };
+  std::deque<Snapshot> m_history;
+  std::unique_ptr<CrashHistory> m_crash_history;
+  std::mutex m_gauge_mutex; ///< Guards the list only; gauge functions are called without it
+  std::vector<std::shared_ptr<Gauge>> m_gauges;
+  GaugeId m_next_gauge_id = 1;
+  std::mutex m_gauge_sampling_mutex; ///< Held while gauge functions run, so that remove_gauge can wait
+  std::atomic<std::thread::id> m_gauge_sampling_thread;
+  mutable std::mutex m_phase_mutex;
+  PhaseCounts m_phase_counts;
 };
 
 } // namespace dunedaq::opmonlib
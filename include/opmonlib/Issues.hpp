@@ -16,6 +16,21 @@ namespace dunedaq {
 
 ERS_DECLARE_ISSUE(opmonlib, OpmonServiceCreationFailed, "OpmonServiceCreationFailed: " << error, ((std::string)error))
 
+ERS_DECLARE_ISSUE(opmonlib,
+                  BadRule,
+                  "Invalid opmon rule " << rule << ": " << reason,
+                  ((std::string)rule)((std::string)reason))
+
+ERS_DECLARE_ISSUE(opmonlib,
+                  ControlSocketFailed,
+                  "Can not open opmon control socket " << path << ": " << reason,
+                  ((std::string)path)((std::string)reason))
+
+ERS_DECLARE_ISSUE(opmonlib,
+                  CrashDumpNotInstalled,
+                  "Opmon snapshots will not be dumped to " << filename << " on a crash: " << reason,
+                  ((std::string)filename)((std::string)reason))
+
 } // namespace dunedaq
 
 #endif // OPMONLIB_INCLUDE_OPMONLIB_ISSUES_HPP_
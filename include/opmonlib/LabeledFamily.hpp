@@ -0,0 +1,143 @@
+/**
+ * @file LabeledFamily.hpp
+ *
+ * A family of identical info records distinguished by one label (e.g. link
+ * id), stored as one dense column per field instead of one child per label.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_LABELEDFAMILY_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_LABELEDFAMILY_HPP_
+
+#include <nlohmann/json.hpp>
+
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dunedaq::opmonlib {
+
+template<typename T = double>
+class LabeledFamily
+{
+  static_assert(std::is_arithmetic_v<T>, "LabeledFamily columns must be arithmetic");
+
+public:
+  LabeledFamily(std::string info_type, std::string label_name, std::vector<std::string> field_names)
+    : m_info_type(std::move(info_type))
+    , m_label_name(std::move(label_name))
+    , m_field_names(std::move(field_names))
+    , m_columns(m_field_names.size())
+  {}
+
+  // Build a family whose fields are the numeric fields of the generated info struct I
+  template<typename I>
+  static LabeledFamily for_record(std::string label_name)
+  {
+    std::vector<std::string> fields;
+    nlohmann::json j = I();
+    for (auto& [key, value] : j.items())
+      if (value.is_number() || value.is_boolean())
+        fields.push_back(key);
+    return LabeledFamily(I::info_type, std::move(label_name), std::move(fields));
+  }
+
+  // Append a label, with all fields zeroed; returns its index
+  size_t add_label(std::string label)
+  {
+    m_labels.push_back(std::move(label));
+    for (auto& c : m_columns)
+      c.push_back(T());
+    return m_labels.size() - 1;
+  }
+
+  void set(size_t field, size_t label, T value) { m_columns[field][label] = value; }
+
+  // Copy every field of the generated info struct into the row of a label
+  template<typename I>
+  void set_record(size_t label, const I& info)
+  {
+    nlohmann::json j = info;
+    for (size_t f = 0; f < m_field_names.size(); ++f) {
+      auto it = j.find(m_field_names[f]);
+      if (it != j.end())
+        m_columns[f][label] = it->is_boolean() ? T(it->template get<bool>()) : it->template get<T>();
+    }
+  }
+
+  T* column(size_t field) { return m_columns[field].data(); }
+  const T* column(size_t field) const { return m_columns[field].data(); }
+
+  // Rollups over the label dimension. Independent lane accumulators let the
+  // compiler vectorise these loops without relaxing floating point semantics.
+  T sum(size_t field) const
+  {
+    const T* d = column(field);
+    T acc[s_lanes] = {};
+    size_t i = 0;
+    for (; i + s_lanes <= size(); i += s_lanes)
+      for (size_t l = 0; l < s_lanes; ++l)
+        acc[l] += d[i + l];
+    T result = T();
+    for (size_t l = 0; l < s_lanes; ++l)
+      result += acc[l];
+    for (; i < size(); ++i)
+      result += d[i];
+    return result;
+  }
+
+  T min(size_t field) const
+  {
+    return reduce(field, [](T a, T b) { return b < a ? b : a; });
+  }
+
+  T max(size_t field) const
+  {
+    return reduce(field, [](T a, T b) { return b > a ? b : a; });
+  }
+
+  size_t size() const { return m_labels.size(); }
+  const std::string& get_info_type() const { return m_info_type; }
+  const std::string& get_label_name() const { return m_label_name; }
+  const std::vector<std::string>& get_labels() const { return m_labels; }
+  const std::vector<std::string>& get_field_names() const { return m_field_names; }
+
+private:
+  static constexpr size_t s_lanes = 8;
+
+  template<typename F>
+  T reduce(size_t field, F op) const
+  {
+    if (size() == 0)
+      return T();
+    const T* d = column(field);
+    T acc[s_lanes];
+    for (size_t l = 0; l < s_lanes; ++l)
+      acc[l] = d[0];
+    size_t i = 0;
+    for (; i + s_lanes <= size(); i += s_lanes)
+      for (size_t l = 0; l < s_lanes; ++l)
+        acc[l] = op(acc[l], d[i + l]);
+    T result = acc[0];
+    for (size_t l = 1; l < s_lanes; ++l)
+      result = op(result, acc[l]);
+    for (; i < size(); ++i)
+      result = op(result, d[i]);
+    return result;
+  }
+
+  std::string m_info_type;
+  std::string m_label_name;
+  std::vector<std::string> m_field_names;
+  std::vector<std::string> m_labels;
+  std::vector<std::vector<T>> m_columns;
+};
+
+} // namespace dunedaq::opmonlib
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_LABELEDFAMILY_HPP_
@@ -0,0 +1,206 @@
+/**
+ * @file LatencyProbe.hpp
+ *
+ * Low-overhead latency instrumentation for hot paths. Timestamps are taken
+ * from the CPU time-stamp counter and accumulated into per-thread histogram
+ * slots, which are merged only when the probe is added to an InfoCollector.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_LATENCYPROBE_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_LATENCYPROBE_HPP_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define OPMONLIB_HAVE_RDTSC 1
+#endif
+
+namespace dunedaq::opmonlib {
+
+/**
+ * @brief Cycle counter clock
+ *
+ * now() reads the TSC directly; the conversion factor to nanoseconds is
+ * calibrated once against CLOCK_MONOTONIC and is only needed when results
+ * are reported. On platforms without a TSC, ticks are steady_clock nanoseconds.
+ */
+class TscClock
+{
+public:
+  static uint64_t now() noexcept // NOLINT(build/unsigned)
+  {
+#ifdef OPMONLIB_HAVE_RDTSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+  }
+
+  static double ns_per_tick() noexcept;
+  static double to_ns(uint64_t ticks) noexcept { return static_cast<double>(ticks) * ns_per_tick(); } // NOLINT
+};
+
+/**
+ * @brief Merged view of a LatencyProbe, all times in nanoseconds
+ */
+struct LatencyStats
+{
+  uint64_t count = 0; // NOLINT(build/unsigned)
+  double mean_ns = 0.;
+  double min_ns = 0.;
+  double max_ns = 0.;
+  double p50_ns = 0.;
+  double p90_ns = 0.;
+  double p99_ns = 0.;
+};
+
+/**
+ * @brief Named latency histogram, safe to record from any thread
+ *
+ * Up to s_num_slots - 1 live recording threads each own a cache-line aligned
+ * slot and update it without read-modify-write instructions; any further
+ * threads share the last slot through atomic increments. A thread gives its
+ * slot back when it exits, so that thread churn does not push new threads
+ * into the shared slot. Buckets are powers of two of TSC ticks.
+ */
+class LatencyProbe
+{
+public:
+  static constexpr size_t s_num_buckets = 64;
+  static constexpr size_t s_num_slots = 16;
+
+  explicit LatencyProbe(std::string name)
+    : m_name(std::move(name))
+  {}
+  LatencyProbe(const LatencyProbe&) = delete;            ///< LatencyProbe is not copy-constructible
+  LatencyProbe& operator=(const LatencyProbe&) = delete; ///< LatencyProbe is not copy-assignable
+
+  // Record one measurement, in TSC ticks
+  void record(uint64_t ticks) noexcept // NOLINT(build/unsigned)
+  {
+    auto index = thread_index();
+    if (index < s_num_slots - 1) {
+      m_slots[index].record_exclusive(ticks);
+    } else {
+      m_slots[s_num_slots - 1].record_shared(ticks);
+    }
+  }
+
+  // Merge all slots; called at gather time, never on the hot path
+  LatencyStats get_stats() const;
+
+  const std::string& get_name() const { return m_name; }
+
+private:
+  struct alignas(64) Slot
+  {
+    std::atomic<uint64_t> count{ 0 };                           // NOLINT(build/unsigned)
+    std::atomic<uint64_t> sum{ 0 };                             // NOLINT(build/unsigned)
+    std::atomic<uint64_t> min{ UINT64_MAX };                    // NOLINT(build/unsigned)
+    std::atomic<uint64_t> max{ 0 };                             // NOLINT(build/unsigned)
+    std::array<std::atomic<uint64_t>, s_num_buckets> buckets{}; // NOLINT(build/unsigned)
+
+    // Only the owning thread writes, so plain relaxed load/store pairs suffice
+    void record_exclusive(uint64_t ticks) noexcept // NOLINT(build/unsigned)
+    {
+      count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      sum.store(sum.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+      auto& bucket = buckets[bucket_of(ticks)];
+      bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      if (ticks < min.load(std::memory_order_relaxed))
+        min.store(ticks, std::memory_order_relaxed);
+      if (ticks > max.load(std::memory_order_relaxed))
+        max.store(ticks, std::memory_order_relaxed);
+    }
+
+    // Overflow slot shared by all threads beyond the first s_num_slots - 1
+    void record_shared(uint64_t ticks) noexcept // NOLINT(build/unsigned)
+    {
+      count.fetch_add(1, std::memory_order_relaxed);
+      sum.fetch_add(ticks, std::memory_order_relaxed);
+      buckets[bucket_of(ticks)].fetch_add(1, std::memory_order_relaxed);
+      auto cur = min.load(std::memory_order_relaxed);
+      while (ticks < cur && !min.compare_exchange_weak(cur, ticks, std::memory_order_relaxed)) {
+      }
+      cur = max.load(std::memory_order_relaxed);
+      while (ticks > cur && !max.compare_exchange_weak(cur, ticks, std::memory_order_relaxed)) {
+      }
+    }
+  };
+
+  static size_t bucket_of(uint64_t ticks) noexcept { return 63 - __builtin_clzll(ticks | 1); } // NOLINT
+
+  static_assert(s_num_slots - 1 <= 32, "free slots are tracked in a 32 bit mask");
+
+  // Exclusive slot index of a thread, shared by all probes, returned to the free mask when the thread exits.
+  // The release/acquire pair makes the last updates of the previous owner visible to the next one.
+  struct SlotLease
+  {
+    SlotLease() noexcept
+    {
+      auto free = s_free_slots.load(std::memory_order_relaxed);
+      while (free != 0) {
+        auto bit = static_cast<size_t>(__builtin_ctz(free));
+        if (s_free_slots.compare_exchange_weak(free, free & ~(1u << bit), std::memory_order_acquire)) {
+          index = bit;
+          return;
+        }
+      }
+    }
+    ~SlotLease()
+    {
+      if (index < s_num_slots - 1)
+        s_free_slots.fetch_or(1u << index, std::memory_order_release);
+    }
+    SlotLease(const SlotLease&) = delete;
+    SlotLease& operator=(const SlotLease&) = delete;
+
+    size_t index = s_num_slots - 1; ///< The shared slot if none was free
+  };
+
+  static size_t thread_index() noexcept
+  {
+    static thread_local const SlotLease lease;
+    return lease.index;
+  }
+
+  static inline std::atomic<uint32_t> s_free_slots{ (1u << (s_num_slots - 1)) - 1 }; // NOLINT(build/unsigned)
+
+  std::string m_name;
+  std::array<Slot, s_num_slots> m_slots;
+};
+
+/**
+ * @brief RAII timer recording the lifetime of the enclosing scope into a LatencyProbe
+ */
+class ScopedTimer
+{
+public:
+  explicit ScopedTimer(LatencyProbe& probe) noexcept
+    : m_probe(probe)
+    , m_start(TscClock::now())
+  {}
+  ~ScopedTimer() { m_probe.record(TscClock::now() - m_start); }
+  ScopedTimer(const ScopedTimer&) = delete;            ///< ScopedTimer is not copy-constructible
+  ScopedTimer& operator=(const ScopedTimer&) = delete; ///< ScopedTimer is not copy-assignable
+
+private:
+  LatencyProbe& m_probe;
+  uint64_t m_start; // NOLINT(build/unsigned)
+};
+
+} // namespace dunedaq::opmonlib
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_LATENCYPROBE_HPP_
@@ -0,0 +1,61 @@
+/**
+ * @file Levels.hpp
+ *
+ * Compile-time limit on monitoring levels. Monitoring above OPMONLIB_MAX_LEVEL
+ * (set with the CMake option of the same name) is compiled out: schema fields
+ * with a higher "level" attribute are left out of the generated structures and
+ * their JSON conversions, and InfoCollector::add<L>() calls with a higher L
+ * do nothing. By default nothing is compiled out.
+ *
+ * The structures then differ with the level, so all code linked together must
+ * agree on it: every translation unit including this file refers to a symbol
+ * named after its level, which the library only defines for its own, and a
+ * mismatch fails to link with an undefined reference to
+ * dunedaq::opmonlib::levels::compiled_with_max_level_N.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_LEVELS_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_LEVELS_HPP_
+
+#ifndef OPMONLIB_MAX_LEVEL
+#define OPMONLIB_MAX_LEVEL 2147483647 // NOLINT(build/define_used)
+#endif
+
+// For code that is only needed up to a level, e.g. filling fields that may be compiled out:
+// #if OPMONLIB_LEVEL_ENABLED(3)
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_LEVEL_ENABLED(level) ((level) <= OPMONLIB_MAX_LEVEL)
+
+namespace dunedaq::opmonlib {
+
+inline constexpr int max_level = OPMONLIB_MAX_LEVEL;
+
+constexpr bool
+level_enabled(int level)
+{
+  return level <= max_level;
+}
+
+namespace levels {
+
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_LEVEL_SYMBOL_IMPL(level) compiled_with_max_level_##level
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_LEVEL_SYMBOL(level) OPMONLIB_LEVEL_SYMBOL_IMPL(level)
+
+// Defined in src/Levels.cpp for the level the library was built with
+extern const int OPMONLIB_LEVEL_SYMBOL(OPMONLIB_MAX_LEVEL);
+
+// Kept in every object file so that the reference reaches the linker
+[[maybe_unused]] __attribute__((used)) static const int* const s_level_check =
+  &OPMONLIB_LEVEL_SYMBOL(OPMONLIB_MAX_LEVEL);
+
+} // namespace levels
+
+} // namespace dunedaq::opmonlib
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_LEVELS_HPP_
@@ -0,0 +1,132 @@
+/**
+ * @file Metrics.hpp
+ *
+ * Counters, gauges and histograms for hot translation units. This header
+ * only depends on <atomic>: it pulls in no json, iostream, cetlib or logging
+ * headers, and every metric has a constexpr constructor, so that metrics
+ * defined at namespace scope need no static initializer. They are turned into
+ * info blocks by the InfoCollector::add overloads, which live in the library.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_METRICS_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_METRICS_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace dunedaq::opmonlib {
+
+/**
+ * @brief Monotonic event count, published as "count"
+ */
+class Counter
+{
+public:
+  constexpr explicit Counter(const char* name) noexcept
+    : m_name(name)
+  {}
+  Counter(const Counter&) = delete;            ///< Counter is not copy-constructible
+  Counter& operator=(const Counter&) = delete; ///< Counter is not copy-assignable
+
+  void increment(uint64_t n = 1) noexcept { m_value.fetch_add(n, std::memory_order_relaxed); } // NOLINT
+
+  uint64_t get_value() const noexcept { return m_value.load(std::memory_order_relaxed); } // NOLINT
+  const char* get_name() const noexcept { return m_name; }
+
+private:
+  const char* m_name;
+  std::atomic<uint64_t> m_value{ 0 }; // NOLINT(build/unsigned)
+};
+
+/**
+ * @brief Last value of a quantity that goes up and down, published as "value"
+ */
+class Gauge
+{
+public:
+  constexpr explicit Gauge(const char* name) noexcept
+    : m_name(name)
+  {}
+  Gauge(const Gauge&) = delete;            ///< Gauge is not copy-constructible
+  Gauge& operator=(const Gauge&) = delete; ///< Gauge is not copy-assignable
+
+  void set(double value) noexcept { m_value.store(value, std::memory_order_relaxed); }
+
+  void add(double delta) noexcept
+  {
+    auto cur = m_value.load(std::memory_order_relaxed);
+    while (!m_value.compare_exchange_weak(cur, cur + delta, std::memory_order_relaxed)) {
+    }
+  }
+
+  double get_value() const noexcept { return m_value.load(std::memory_order_relaxed); }
+  const char* get_name() const noexcept { return m_name; }
+
+private:
+  const char* m_name;
+  std::atomic<double> m_value{ 0. };
+};
+
+/**
+ * @brief Merged view of a Histogram
+ */
+struct HistogramStats
+{
+  uint64_t count = 0; // NOLINT(build/unsigned)
+  double sum = 0.;
+  double mean = 0.;
+  double max = 0.;
+  double p50 = 0.;
+  double p90 = 0.;
+  double p99 = 0.;
+};
+
+/**
+ * @brief Distribution of non-negative integer values (sizes, durations, depths)
+ *
+ * Buckets are powers of two, so recording is a handful of relaxed atomic
+ * increments shared by all threads; for per-thread latency histograms of
+ * very hot paths, see LatencyProbe.
+ */
+class Histogram
+{
+public:
+  static constexpr size_t s_num_buckets = 65; // Zero, then one per bit width
+
+  constexpr explicit Histogram(const char* name) noexcept
+    : m_name(name)
+  {}
+  Histogram(const Histogram&) = delete;            ///< Histogram is not copy-constructible
+  Histogram& operator=(const Histogram&) = delete; ///< Histogram is not copy-assignable
+
+  void record(uint64_t value) noexcept // NOLINT(build/unsigned)
+  {
+    m_buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    auto cur = m_max.load(std::memory_order_relaxed);
+    while (value > cur && !m_max.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {
+    }
+  }
+
+  // Merge the buckets; called at gather time, never on the hot path
+  HistogramStats get_stats() const;
+
+  const char* get_name() const noexcept { return m_name; }
+
+private:
+  static size_t bucket_of(uint64_t value) noexcept { return value == 0 ? 0 : 64 - __builtin_clzll(value); } // NOLINT
+
+  const char* m_name;
+  std::atomic<uint64_t> m_sum{ 0 };                  // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_max{ 0 };                  // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_buckets[s_num_buckets]{}; // NOLINT
+};
+
+} // namespace dunedaq::opmonlib
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_METRICS_HPP_
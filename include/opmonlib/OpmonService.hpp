@@ -13,13 +13,13 @@
 
 #include "logging/Logging.hpp"
 
-#include <cetlib/BasicPluginFactory.h>
 #include <cetlib/compiler_macros.h>
 #include <nlohmann/json.hpp>
 
 #include <iostream>
 #include <memory>
 #include <string>
+#include <utility>
 
 #ifndef EXTERN_C_FUNC_DECLARE_START
 // NOLINTNEXTLINE(build/define_used)
@@ -47,7 +47,9 @@ namespace dunedaq::opmonlib {
 class OpmonService
 {
 public:
-  explicit OpmonService(std::string /*service*/) {}
+  explicit OpmonService(std::string service)
+    : m_uri(std::move(service))
+  {}
   virtual ~OpmonService() = default;
   OpmonService(const OpmonService&) = delete;            ///< OpmonService is not copy-constructible
   OpmonService& operator=(const OpmonService&) = delete; ///< OpmonService is not copy-assignable
@@ -57,34 +59,47 @@ public:
   // Publish information
   virtual void publish(nlohmann::json j) = 0;
 
+  // Publish a discrete event; services with a dedicated low-latency path override this
+  virtual void publish_event(nlohmann::json j) { publish(std::move(j)); }
+
+  // Services writing snapshots as text in one of the formats of serialize_snapshot() return it here.
+  // InfoManager then serializes each snapshot once for all the services of that format and calls
+  // publish_serialized() instead of publish(). Empty for services doing their own encoding.
+  virtual std::string get_format() const { return std::string(); }
+  virtual void publish_serialized(const std::string& /*text*/) {}
+
+  // URI the service was created with, as reported by the trace probes
+  const std::string& get_uri() const { return m_uri; }
+
 private:
+  std::string m_uri;
 };
 
+using OpmonServiceMaker = std::shared_ptr<OpmonService> (*)(const std::string& service);
+
+/**
+ * @brief Make a compiled-in service available under `scheme`, ahead of any plugin of the same name
+ * @return false if the scheme was already registered, in which case the registration is ignored
+ */
+bool
+registerOpmonService(const std::string& scheme, OpmonServiceMaker maker);
+
+/**
+ * @brief Create the service for a URI, "scheme://...", or "stdout" when there is no scheme
+ *
+ * The stdout, file and tsfile services are built into the library; other
+ * schemes are loaded from the "<scheme>OpmonService" plugin.
+ */
 std::shared_ptr<OpmonService>
-makeOpmonService(std::string const& service)
-{
-  TLOG() << "SERVICE = " << service;
-  auto sep = service.find("://");
-  std::string scheme;
-  if (sep == std::string::npos) { // simple path
-    scheme = "stdout";
-  } else { // with scheme
-    scheme = service.substr(0, sep);
-  }
-  std::string plugin_name = scheme + "OpmonService";
-  static cet::BasicPluginFactory bpf("duneOpmonService", "make");
-  std::shared_ptr<OpmonService> os_ptr;
-  try {
-    os_ptr = bpf.makePlugin<std::shared_ptr<OpmonService>>(plugin_name, service);
-  } catch (const cet::exception& cexpt) {
-    throw OpmonServiceCreationFailed(ERS_HERE, service, cexpt);
-  } catch (const ers::Issue& iexpt) {
-    throw OpmonServiceCreationFailed(ERS_HERE, service, iexpt);
-  } catch (...) { // NOLINT JCF Jan-27-2021 violates letter of the law but not the spirit
-    throw OpmonServiceCreationFailed(ERS_HERE, service, "Unknown error.");
-  }
-  return os_ptr;
-}
+makeOpmonService(std::string const& service);
+
+/**
+ * @brief Serialize a snapshot as "json" (compact), "json-indented" (by 2) or "json-flat"
+ * (flattened to json pointers, indented by 4)
+ * @return false if the format is not one of these
+ */
+bool
+serialize_snapshot(const std::string& format, const nlohmann::json& j, std::string& text);
 
 } // namespace dunedaq::opmonlib
 
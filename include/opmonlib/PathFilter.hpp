@@ -0,0 +1,69 @@
+/**
+ * @file PathFilter.hpp
+ *
+ * Include/exclude filter on dot separated monitoring paths, compiled into
+ * tries so that whole subtrees can be skipped before they are gathered.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_PATHFILTER_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_PATHFILTER_HPP_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dunedaq::opmonlib {
+
+/**
+ * @brief Path filter
+ *
+ * Patterns are dot separated paths in which a "*" segment matches any single
+ * name, e.g. "partition.*.dataflow". A pattern matches its node and the whole
+ * subtree below it. A node is kept if it is not matched by any exclude
+ * pattern and, when include patterns are given, is matched by one of them.
+ */
+class PathFilter
+{
+public:
+  enum class Decision
+  {
+    kPrune,   ///< Neither the node nor anything below it is wanted
+    kDescend, ///< Only some descendants are wanted; the node's own info can be dropped
+    kAccept   ///< The node and its subtree are wanted
+  };
+
+  PathFilter() = default;
+  PathFilter(const PathFilter& other);
+  PathFilter& operator=(const PathFilter& other);
+
+  void include(const std::string& pattern);
+  void exclude(const std::string& pattern);
+  bool empty() const { return !m_include && !m_exclude; }
+
+  Decision check(const std::string& path) const;
+
+  static std::vector<std::string> split(const std::string& path);
+
+private:
+  struct Node
+  {
+    std::map<std::string, std::unique_ptr<Node>> children;
+    bool terminal = false;
+  };
+
+  static void insert(std::unique_ptr<Node>& root, const std::string& pattern);
+  static Decision match(const Node& node, const std::vector<std::string>& segments, size_t depth);
+  static void copy(const std::unique_ptr<Node>& from, std::unique_ptr<Node>& to);
+
+  std::unique_ptr<Node> m_include;
+  std::unique_ptr<Node> m_exclude;
+};
+
+} // namespace dunedaq::opmonlib
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_PATHFILTER_HPP_
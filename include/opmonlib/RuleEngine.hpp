@@ -0,0 +1,90 @@
+/**
+ * @file RuleEngine.hpp
+ *
+ * Threshold rules evaluated in-process against every gathered snapshot.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_RULEENGINE_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_RULEENGINE_HPP_
+
+#include "opmonlib/Issues.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dunedaq::opmonlib {
+
+/**
+ * @brief Set of threshold rules compiled from configuration
+ *
+ * Each rule is a json object such as
+ *   { "name": "queue_full", "path": "partition.module", "info_type": "mymodule.Info",
+ *     "field": "occupancy", "denominator": "capacity", "op": ">", "threshold": 0.9,
+ *     "cycles": 3, "severity": "error" }
+ * meaning "occupancy / capacity > 0.9 for 3 consecutive snapshots". "denominator",
+ * "cycles" (default 1) and "severity" (default "warning") are optional. Paths are
+ * split when the rule is added, and each info block is looked up once per snapshot
+ * however many rules refer to it. An alarm is raised when a rule becomes true and
+ * cleared when it stops being true.
+ */
+class RuleEngine
+{
+public:
+  // Compile one rule, or an array of rules; throws BadRule
+  void add_rules(const nlohmann::json& config);
+
+  // Evaluate all rules against the tree of a snapshot, below its parent tag,
+  // appending raised/cleared alarms to `alarms`
+  void evaluate(const nlohmann::json& tree, std::vector<nlohmann::json>& alarms);
+
+  bool empty();
+
+  // Dot separated paths of the nodes the rules read, each once
+  std::vector<std::string> get_paths();
+
+private:
+  enum class Comparison
+  {
+    kGreater,
+    kGreaterEqual,
+    kLess,
+    kLessEqual,
+    kEqual,
+    kNotEqual
+  };
+
+  struct Rule
+  {
+    std::string name;
+    std::string path;
+    std::string severity;
+    size_t block; ///< Index in m_blocks
+    std::string value;
+    std::string denominator;
+    bool has_denominator = false;
+    Comparison comparison;
+    double threshold;
+    uint32_t cycles;        // NOLINT(build/unsigned)
+    uint32_t streak = 0;    // NOLINT(build/unsigned)
+    bool active = false;
+  };
+
+  void add_rule(const nlohmann::json& config);
+
+  std::mutex m_mutex;
+  std::vector<Rule> m_rules;
+  std::vector<std::vector<std::string>> m_blocks; ///< Keys leading to the data of each info block used
+  std::vector<const nlohmann::json*> m_resolved;  ///< Data of each block in the snapshot evaluated, or null
+};
+
+} // namespace dunedaq::opmonlib
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_RULEENGINE_HPP_
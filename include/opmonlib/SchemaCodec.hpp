@@ -0,0 +1,64 @@
+/**
+ * @file SchemaCodec.hpp
+ *
+ * Schema-once, values-many encoding of opmon snapshots. The structure of a
+ * snapshot (all its keys) is sent once as a schema message:
+ *   {"__schema": {"id": 3, "skeleton": <snapshot with each value replaced by its field id>}}
+ * and each snapshot of the same structure as a values message holding the
+ * values in field id order, i.e. the ids are implicit in the position:
+ *   {"__values": {"schema": 3, "data": [v0, v1, ...]}}
+ * A new schema is sent whenever the structure changes. Messages that are not
+ * snapshots (e.g. events) pass through unchanged.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_SCHEMACODEC_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_SCHEMACODEC_HPP_
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace dunedaq::opmonlib {
+
+class SchemaEncoder
+{
+public:
+  static inline constexpr char s_schema_tag[]{ "__schema" };
+  static inline constexpr char s_values_tag[]{ "__values" };
+
+  // Messages to send for `message`, in order: a schema if the structure changed, then the values
+  std::vector<nlohmann::json> encode(const nlohmann::json& message);
+
+  uint64_t get_schema_id() const { return m_id; } // NOLINT(build/unsigned)
+
+private:
+  bool copy_values(const nlohmann::json& skeleton, const nlohmann::json& j, nlohmann::json& data) const;
+  void build_skeleton(const nlohmann::json& j, nlohmann::json& skeleton, nlohmann::json& data) const;
+
+  nlohmann::json m_skeleton;
+  size_t m_num_fields = 0;
+  uint64_t m_id = 0; // NOLINT(build/unsigned)
+};
+
+class SchemaDecoder
+{
+public:
+  // Feed one message; returns true and fills `snapshot` when a snapshot is complete.
+  // Messages that are not schema or values messages are returned unchanged.
+  bool decode(const nlohmann::json& message, nlohmann::json& snapshot);
+
+private:
+  static void fill(const nlohmann::json& skeleton, const nlohmann::json& data, nlohmann::json& snapshot);
+
+  nlohmann::json m_skeleton;
+  uint64_t m_id = 0; // NOLINT(build/unsigned)
+};
+
+} // namespace dunedaq::opmonlib
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_SCHEMACODEC_HPP_
@@ -0,0 +1,135 @@
+/**
+ * @file TimeSeries.hpp
+ *
+ * Compact encoding of opmon values as one stream per series: delta-of-delta
+ * timestamps, XOR encoded doubles and zigzag varint integer deltas, in the
+ * style of Facebook's Gorilla.
+ *
+ * A file is the magic "OPTS" followed by records, each starting with a tag byte:
+ *   'S' varint id, varint name length, name, kind (0: integer, 1: double)
+ *   'B' varint id, varint sample count, varint byte length, bit stream
+ * Each block is decodable on its own, so a file can be appended to and a
+ * truncated last block is simply dropped by the reader.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_TIMESERIES_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_TIMESERIES_HPP_
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dunedaq::opmonlib {
+
+/**
+ * Call `f(series, time, value)` for every scalar in the info blocks of a
+ * snapshot, with series named "<node path>/<info type>/<field>", array
+ * elements as "field[i]" and object members as "field.member".
+ */
+void
+visit_series(const nlohmann::json& snapshot,
+             const std::function<void(const std::string& series, int64_t time, const nlohmann::json& value)>& f);
+
+class TimeSeriesWriter
+{
+public:
+  static inline constexpr char s_magic[]{ "OPTS" };
+
+  // Samples of a series are written out as a block every `block_size` samples;
+  // the magic is left out when appending to an existing file
+  explicit TimeSeriesWriter(std::ostream& os, size_t block_size = 120, bool write_magic = true);
+  ~TimeSeriesWriter();
+
+  void append(const std::string& series, int64_t time, int64_t value);
+  void append(const std::string& series, int64_t time, double value);
+  // Integers, floats and booleans are appended, anything else is ignored
+  void append(const std::string& series, int64_t time, const nlohmann::json& value);
+
+  // Write the pending samples of all series
+  void flush();
+
+  size_t get_bytes_written() const { return m_bytes_written; }
+
+private:
+  class BitWriter
+  {
+  public:
+    void write(uint64_t bits, unsigned n); // NOLINT(build/unsigned)
+    void write_varint(uint64_t value);     // NOLINT(build/unsigned)
+    const std::vector<uint8_t>& bytes() const { return m_bytes; } // NOLINT(build/unsigned)
+    void clear()
+    {
+      m_bytes.clear();
+      m_bit = 0;
+    }
+
+  private:
+    std::vector<uint8_t> m_bytes; // NOLINT(build/unsigned)
+    unsigned m_bit = 0;
+  };
+
+  struct Stream
+  {
+    uint64_t id;     // NOLINT(build/unsigned)
+    bool is_double;
+    size_t count = 0;
+    int64_t time = 0;
+    int64_t time_delta = 0;
+    uint64_t value = 0; // NOLINT(build/unsigned) Previous value, as bits for doubles
+    unsigned leading = ~0U;
+    unsigned trailing = 0;
+    BitWriter bits;
+  };
+
+  Stream& stream(const std::string& series, bool is_double);
+  void append_time(Stream& s, int64_t time);
+  void append_bits(Stream& s, uint64_t value); // NOLINT(build/unsigned)
+  void write_block(Stream& s);
+  void write_varint(uint64_t value);           // NOLINT(build/unsigned)
+
+  std::ostream& m_os;
+  size_t m_block_size;
+  size_t m_bytes_written = 0;
+  uint64_t m_next_id = 0; // NOLINT(build/unsigned)
+  std::unordered_map<std::string, Stream> m_streams;
+};
+
+class TimeSeriesReader
+{
+public:
+  struct Sample
+  {
+    int64_t time;
+    bool is_double;
+    int64_t integer;
+    double real;
+  };
+  using Callback = std::function<void(const std::string& series, const Sample& sample)>;
+
+  // Decode all the samples of `is`; returns false if the stream is not a
+  // time series file or ends within a record
+  bool read(std::istream& is, const Callback& f);
+
+private:
+  struct Series
+  {
+    std::string name;
+    bool is_double;
+  };
+  std::map<uint64_t, Series> m_series; // NOLINT(build/unsigned)
+};
+
+} // namespace dunedaq::opmonlib
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_TIMESERIES_HPP_
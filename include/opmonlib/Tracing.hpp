@@ -0,0 +1,102 @@
+/**
+ * @file Tracing.hpp
+ *
+ * USDT (user statically defined tracing) probes of the "opmonlib" provider,
+ * for bpftrace, perf or SystemTap. They are compiled in when <sys/sdt.h>
+ * is available and OPMONLIB_NO_USDT is not defined; otherwise they expand to
+ * nothing.
+ *
+ * An unattached probe is a single nop. Every probe has a semaphore, which the
+ * tracer increments when it attaches (sys/sdt.h references one for each probe
+ * once semaphores are enabled); those of probes reporting a duration are
+ * checked so that the clock is only read while someone is listening. A
+ * semaphore is defined with OPMONLIB_PROBE_SEMAPHORE at global scope, once per
+ * shared object; other translation units of the same object firing the probe
+ * use OPMONLIB_PROBE_SEMAPHORE_DECLARATION.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef OPMONLIB_INCLUDE_OPMONLIB_TRACING_HPP_
+#define OPMONLIB_INCLUDE_OPMONLIB_TRACING_HPP_
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__has_include) && !defined(OPMONLIB_NO_USDT)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1 // NOLINT(build/define_used)
+#include <sys/sdt.h>
+#define OPMONLIB_HAVE_USDT 1 // NOLINT(build/define_used)
+#endif
+#endif
+
+#ifdef OPMONLIB_HAVE_USDT
+
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_PROBE_SEMAPHORE(name)                                                                                 \
+  extern "C"                                                                                                           \
+  {                                                                                                                    \
+    __attribute__((visibility("hidden"))) volatile unsigned short opmonlib_##name##_semaphore                        \
+      __attribute__((section(".probes")));                                                                             \
+  }                                                                                                                    \
+  static_assert(true, "")
+
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_PROBE_SEMAPHORE_DECLARATION(name)                                                                     \
+  extern "C" __attribute__((visibility("hidden"))) volatile unsigned short opmonlib_##name##_semaphore
+
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_PROBE_ENABLED(name) __builtin_expect(opmonlib_##name##_semaphore != 0, 0)
+
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_PROBE1(name, a1) DTRACE_PROBE1(opmonlib, name, a1)
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_PROBE2(name, a1, a2) DTRACE_PROBE2(opmonlib, name, a1, a2)
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(opmonlib, name, a1, a2, a3)
+
+#else
+
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_PROBE_SEMAPHORE(name) static_assert(true, "")
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_PROBE_SEMAPHORE_DECLARATION(name) static_assert(true, "")
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_PROBE_ENABLED(name) false
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_PROBE1(name, a1)                                                                                      \
+  do {                                                                                                                 \
+    (void)sizeof(a1);                                                                                                  \
+  } while (false)
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_PROBE2(name, a1, a2)                                                                                  \
+  do {                                                                                                                 \
+    (void)sizeof(a1);                                                                                                  \
+    (void)sizeof(a2);                                                                                                  \
+  } while (false)
+// NOLINTNEXTLINE(build/define_used)
+#define OPMONLIB_PROBE3(name, a1, a2, a3)                                                                              \
+  do {                                                                                                                 \
+    (void)sizeof(a1);                                                                                                  \
+    (void)sizeof(a2);                                                                                                  \
+    (void)sizeof(a3);                                                                                                  \
+  } while (false)
+
+#endif
+
+namespace dunedaq::opmonlib::tracing {
+
+// Timestamp in nanoseconds for probe durations
+inline int64_t
+now_ns() noexcept
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+} // namespace dunedaq::opmonlib::tracing
+
+#endif // OPMONLIB_INCLUDE_OPMONLIB_TRACING_HPP_
@@ -1,6 +1,13 @@
+import heapq
 import json
+import multiprocessing
 import os
+import shutil
+import sys
+import tempfile
+import zipfile
 import rich.traceback
+from collections import OrderedDict
 from rich.console import Console
 from os.path import exists, join
 
@@ -11,55 +18,280 @@ console = Console()
 
 import click
 
-@click.command(context_settings=CONTEXT_SETTINGS)
-@click.option('-o', '--output-file', type=click.File('w'), default='opmon_collated.json')
-@click.argument('json_files', type=click.File('r'), nargs=-1)
-
-def cli(output_file, json_files):
-    
-    console.log(f"Reading specified JSON files and outputting collated value traces to {output_file.name}")
-
-    jsons = []
-    for jf in json_files:
-        console.log(f"Reading info JSON file {jf.name}")
-        for line in jf:
-            jsons.append(json.loads(line))
+# format is partition.objectinstance.key.time: value
 
-    #console.log(jsons)
+def fill_skeleton(skeleton, data):
+    """Rebuild a snapshot from the skeleton of a schema message, whose leaves are indices into data."""
+    if isinstance(skeleton, dict):
+        return {key: fill_skeleton(value, data) for key, value in skeleton.items()}
+    if isinstance(skeleton, list):
+        return [fill_skeleton(value, data) for value in skeleton]
+    return data[skeleton]
 
-    data = {}
 
-    # format is partition.objectinstance.key.time: value
+def iter_records(lines):
+    """Yield (partition, objectinstance, key, time, value) for every value in a stream of opmon JSON lines.
 
-    for jsonobj in jsons:
+    key, time and value are None for partitions and object instances without any data,
+    which still appear (empty) in the collated output. Files written with ?encoding=schema
+    are decoded as they are read; values following a schema other than the last one seen are skipped."""
+    schema = None
+    for line in lines:
+        if not line.strip():
+            continue
+        jsonobj = json.loads(line)
+        if '__schema' in jsonobj:
+            schema = jsonobj['__schema']
+            continue
+        if '__values' in jsonobj:
+            values = jsonobj['__values']
+            if schema is None or values['schema'] != schema['id']:
+                continue
+            jsonobj = fill_skeleton(schema['skeleton'], values['data'])
         if '__parent' not in jsonobj:
             continue
         for partition in jsonobj['__parent']:
-            if partition not in data:
-                data[partition] = {}
+            yield partition, None, None, None, None
             partitionobj = jsonobj['__parent'][partition]
-    
-            if '__children' not in partitionobj:
+
+            if not partitionobj or '__children' not in partitionobj:
                 continue
 
             for objectinstance in partitionobj['__children']:
-                if objectinstance not in data[partition]:
-                    data[partition][objectinstance] = {}
+                yield partition, objectinstance, None, None, None
                 objectinstanceobj = partitionobj['__children'][objectinstance]
-            
-                if '__properties' not in objectinstanceobj:
+
+                if not objectinstanceobj or '__properties' not in objectinstanceobj:
                     continue
 
                 for datatype in objectinstanceobj['__properties']:
                     datatypeobj = objectinstanceobj['__properties'][datatype]
                     thistime = datatypeobj['__time']
                     for key in datatypeobj['__data']:
-                        if key not in data[partition][objectinstance]:
-                            data[partition][objectinstance][key] = {}
-                        thisvalue = datatypeobj['__data'][key]
-                        data[partition][objectinstance][key][thistime] = thisvalue
+                        yield partition, objectinstance, key, thistime, datatypeobj['__data'][key]
+
+
+class SeriesStore:
+    """Spills the values of every series to its own file as they are read.
+
+    Memory use is bounded by the number of distinct series (the index) and by
+    max_open_files, not by the size of the input."""
+
+    def __init__(self, directory, max_open_files=256):
+        self.directory = directory
+        self.max_open_files = max_open_files
+        self.index = {}
+        self.open_files = OrderedDict()
+        self.nseries = 0
+
+    def add(self, partition, objectinstance, key, thistime, value):
+        objects = self.index.setdefault(partition, {})
+        if objectinstance is None:
+            return
+        keys = objects.setdefault(objectinstance, {})
+        if key is None:
+            return
+        if key not in keys:
+            keys[key] = [join(self.directory, f"series_{self.nseries}.jsonl")]
+            self.nseries += 1
+        self._file(keys[key][0]).write(json.dumps([thistime, value]) + '\n')
+
+    def _file(self, path):
+        f = self.open_files.pop(path, None)
+        if f is None:
+            if len(self.open_files) >= self.max_open_files:
+                _, oldest = self.open_files.popitem(last=False)
+                oldest.close()
+            f = open(path, 'a')
+        self.open_files[path] = f
+        return f
+
+    def close(self):
+        for f in self.open_files.values():
+            f.close()
+        self.open_files.clear()
+
+    def sort_series(self):
+        """Sort every spill file by time, keeping the input order of equal times."""
+        self.close()
+        for objects in self.index.values():
+            for keys in objects.values():
+                for paths in keys.values():
+                    for path in paths:
+                        with open(path) as f:
+                            lines = sorted(f, key=lambda l: json.loads(l)[0])
+                        with open(path, 'w') as f:
+                            f.writelines(lines)
+
+    def merge(self, index):
+        """Append the series of another store's index, e.g. one produced by a worker process."""
+        for partition, objects in index.items():
+            mine = self.index.setdefault(partition, {})
+            for objectinstance, keys in objects.items():
+                mykeys = mine.setdefault(objectinstance, {})
+                for key, paths in keys.items():
+                    if key not in mykeys:
+                        mykeys[key] = []
+                        self.nseries += 1
+                    mykeys[key].extend(paths)
+
+    @staticmethod
+    def iter_spill(path):
+        with open(path) as f:
+            for line in f:
+                yield json.loads(line)
+
+    def read_series(self, paths):
+        """Load one series as a time: value dict, later values for the same time winning.
+
+        Several spill files, each sorted by time, are combined with a k-way merge; the merge
+        is stable, so for equal times the value from the later file wins as in a serial read."""
+        series = {}
+        if len(paths) == 1:
+            entries = self.iter_spill(paths[0])
+        else:
+            entries = heapq.merge(*(self.iter_spill(p) for p in paths), key=lambda e: e[0])
+        for thistime, value in entries:
+            series[thistime] = value
+        return series
+
+
+def collate_file(args):
+    """Worker: spill the series of one input file into its own directory, sorted by time."""
+    filename, directory = args
+    store = SeriesStore(directory)
+    with open(filename) as f:
+        for record in iter_records(f):
+            store.add(*record)
+    store.sort_series()
+    return filename, store.index
+
+
+def write_collated(store, output_file):
+    """Write the collated dict, in the same layout as json.dump(indent=4, sort_keys=True), one series at a time."""
+    store.close()
+
+    def open_level(name, depth):
+        output_file.write(' ' * 4 * depth + json.dumps(name) + ': ')
+
+    def write_dict(items, depth, write_item):
+        if not items:
+            output_file.write('{}')
+            return
+        output_file.write('{\n')
+        for i, name in enumerate(sorted(items)):
+            open_level(name, depth + 1)
+            write_item(name, depth + 1)
+            output_file.write(',\n' if i + 1 < len(items) else '\n')
+        output_file.write(' ' * 4 * depth + '}')
+
+    def write_series(paths, depth):
+        text = json.dumps(store.read_series(paths), indent=4, sort_keys=True)
+        output_file.write(text.replace('\n', '\n' + ' ' * 4 * depth))
+
+    index = store.index
+    write_dict(index, 0, lambda p, d:
+               write_dict(index[p], d, lambda o, d2:
+                          write_dict(index[p][o], d2, lambda k, d3:
+                                     write_series(index[p][o][k], d3))))
+
+
+def to_array(values):
+    """Numeric values become a numeric (possibly 2D) array; anything else is stored as JSON text."""
+    import numpy
+    try:
+        array = numpy.asarray(values)
+    except ValueError:
+        array = None
+    if array is None or array.dtype == object:
+        array = numpy.array([json.dumps(v) for v in values])
+    return array
+
+
+def iter_arrays(store):
+    """Yield (partition, objectinstance, key, times, values) for every series, in sorted order."""
+    import numpy
+    store.close()
+    for partition, objects in sorted(store.index.items()):
+        for objectinstance, keys in sorted(objects.items()):
+            for key, paths in sorted(keys.items()):
+                series = store.read_series(paths)
+                times = sorted(series)
+                yield (partition, objectinstance, key,
+                       numpy.array(times, dtype=numpy.int64), to_array([series[t] for t in times]))
+
+
+def write_npz(store, filename):
+    """Write all series into one .npz archive, as "<partition>.<objectinstance>.<key>/time" and ".../value".
+
+    Arrays are written into the archive one at a time, so only one series is held in memory."""
+    import numpy
+    with zipfile.ZipFile(filename, 'w', allowZip64=True) as archive:
+        for partition, objectinstance, key, times, values in iter_arrays(store):
+            name = f"{partition}.{objectinstance}.{key}"
+            for suffix, array in (('time', times), ('value', values)):
+                with archive.open(f"{name}/{suffix}.npy", 'w', force_zip64=True) as f:
+                    numpy.lib.format.write_array(f, array, allow_pickle=False)
+
+
+def write_npy(store, directory):
+    """Write every series as a <partition>/<objectinstance>/<key>.time.npy and .value.npy pair,
+    which can be loaded with numpy.load(..., mmap_mode='r')."""
+    import numpy
+    for partition, objectinstance, key, times, values in iter_arrays(store):
+        subdir = join(directory, partition, objectinstance)
+        os.makedirs(subdir, exist_ok=True)
+        base = join(subdir, key.replace(os.sep, '_'))
+        numpy.save(base + '.time.npy', times, allow_pickle=False)
+        numpy.save(base + '.value.npy', values, allow_pickle=False)
+
+
+@click.command(context_settings=CONTEXT_SETTINGS)
+@click.option('-o', '--output-file', type=click.Path(), default=None,
+              help='Output file (directory for npy); default opmon_collated.json, .npz or opmon_collated/')
+@click.option('-f', '--format', 'output_format', type=click.Choice(['json', 'npz', 'npy']), default='json',
+              help='json: one nested dict; npz: one archive of time/value arrays; npy: one .npy pair per series')
+@click.option('-j', '--jobs', type=int, default=1, help='Number of files parsed in parallel (0 for one per core)')
+@click.argument('json_files', type=click.File('r'), nargs=-1)
+
+def cli(output_file, output_format, jobs, json_files):
+
+    if output_file is None:
+        output_file = {'json': 'opmon_collated.json', 'npz': 'opmon_collated.npz', 'npy': 'opmon_collated'}[output_format]
+
+    console.log(f"Reading specified JSON files and outputting collated value traces to {output_file}")
+
+    spill_dir = tempfile.mkdtemp(prefix='opmon_collate_')
+    try:
+        store = SeriesStore(spill_dir)
+        if jobs != 1 and len(json_files) > 1:
+            jobs = jobs if jobs > 0 else os.cpu_count()
+            console.log(f"Reading {len(json_files)} info JSON files with {jobs} processes")
+            tasks = [(jf.name, tempfile.mkdtemp(dir=spill_dir)) for jf in json_files]
+            with multiprocessing.Pool(jobs) as pool:
+                # imap keeps the argument order, which decides which value wins for equal times
+                for filename, index in pool.imap(collate_file, tasks):
+                    console.log(f"Read info JSON file {filename}")
+                    store.merge(index)
+        else:
+            for jf in json_files:
+                console.log(f"Reading info JSON file {jf.name}")
+                for record in iter_records(jf):
+                    store.add(*record)
+
+        console.log(f"Writing {store.nseries} series")
+        if output_format == 'npz':
+            write_npz(store, output_file)
+        elif output_format == 'npy':
+            write_npy(store, output_file)
+        elif output_file == '-':
+            write_collated(store, sys.stdout)
+        else:
+            with open(output_file, 'w') as f:
+                write_collated(store, f)
+    finally:
+        shutil.rmtree(spill_dir, ignore_errors=True)
 
-    json.dump(data, output_file, indent=4, sort_keys=True)
     console.log(f"Operation complete")
 
 
@@ -0,0 +1,198 @@
+/**
+ * @file CrashDump.cpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/CrashDump.hpp"
+
+#include "opmonlib/Issues.hpp"
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <streambuf>
+#include <unistd.h>
+#include <utility>
+
+using namespace dunedaq::opmonlib;
+
+namespace {
+
+constexpr int s_fatal_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+constexpr size_t s_num_fatal_signals = sizeof(s_fatal_signals) / sizeof(s_fatal_signals[0]);
+struct sigaction s_previous_actions[s_num_fatal_signals];
+
+void
+write_all(int fd, const char* data, size_t len)
+{
+  while (len > 0) {
+    auto n = ::write(fd, data, len);
+    if (n <= 0)
+      return;
+    data += n;
+    len -= static_cast<size_t>(n);
+  }
+}
+
+// Alternate signal stack of a thread, removed when the thread exits
+struct AlternateStack
+{
+  AlternateStack()
+  {
+    stack_t current;
+    if (sigaltstack(nullptr, &current) != 0 || !(current.ss_flags & SS_DISABLE))
+      return; // Already has one
+    size_t size = std::max<size_t>(SIGSTKSZ, 1 << 16);
+    memory.reset(new char[size]);
+    stack_t ss;
+    std::memset(&ss, 0, sizeof(ss));
+    ss.ss_sp = memory.get();
+    ss.ss_size = size;
+    if (sigaltstack(&ss, nullptr) != 0)
+      memory.reset();
+  }
+  ~AlternateStack()
+  {
+    if (!memory)
+      return;
+    stack_t ss;
+    std::memset(&ss, 0, sizeof(ss));
+    ss.ss_flags = SS_DISABLE;
+    sigaltstack(&ss, nullptr);
+  }
+  AlternateStack(const AlternateStack&) = delete;            ///< AlternateStack is not copy-constructible
+  AlternateStack& operator=(const AlternateStack&) = delete; ///< AlternateStack is not copy-assignable
+
+  std::unique_ptr<char[]> memory;
+};
+
+} // namespace
+
+// Stream buffer filling a slot, dropping what does not fit
+class CrashHistory::SlotBuffer : public std::streambuf
+{
+public:
+  void reset(char* slot, size_t capacity) { setp(slot, slot + capacity); }
+  size_t length() const { return static_cast<size_t>(pptr() - pbase()); }
+
+protected:
+  int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+};
+
+std::atomic<CrashHistory*> CrashHistory::s_installed{ nullptr };
+
+CrashHistory::CrashHistory(size_t num_snapshots, size_t max_bytes)
+  : m_num_slots(std::max<size_t>(num_snapshots, 1))
+  , m_slot_size(max_bytes)
+  , m_buffer(new char[m_num_slots * m_slot_size])
+  , m_lengths(new std::atomic<size_t>[m_num_slots])
+  , m_slot_buffer(std::make_unique<SlotBuffer>())
+  , m_stream(m_slot_buffer.get())
+{
+  for (size_t i = 0; i < m_num_slots; ++i)
+    m_lengths[i].store(0, std::memory_order_relaxed);
+}
+
+CrashHistory::~CrashHistory()
+{
+  uninstall_handler();
+}
+
+void
+CrashHistory::record(const std::string& snapshot)
+{
+  // The length is cleared while the slot is overwritten, so a crash mid-copy skips it
+  auto len = std::min(snapshot.size(), m_slot_size);
+  m_lengths[m_next].store(0, std::memory_order_release);
+  std::memcpy(m_buffer.get() + m_next * m_slot_size, snapshot.data(), len);
+  m_lengths[m_next].store(len, std::memory_order_release);
+  m_next = (m_next + 1) % m_num_slots;
+}
+
+void
+CrashHistory::record(const nlohmann::json& snapshot)
+{
+  m_lengths[m_next].store(0, std::memory_order_release);
+  m_slot_buffer->reset(m_buffer.get() + m_next * m_slot_size, m_slot_size);
+  m_stream << snapshot;
+  m_stream.clear();
+  m_lengths[m_next].store(m_slot_buffer->length(), std::memory_order_release);
+  m_next = (m_next + 1) % m_num_slots;
+}
+
+void
+CrashHistory::prepare_thread()
+{
+  thread_local AlternateStack stack;
+}
+
+void
+CrashHistory::write_to(int fd) const
+{
+  auto first = m_next;
+  for (size_t i = 0; i < m_num_slots; ++i) {
+    auto slot = (first + i) % m_num_slots;
+    auto len = m_lengths[slot].load(std::memory_order_acquire);
+    if (len == 0)
+      continue;
+    write_all(fd, m_buffer.get() + slot * m_slot_size, len);
+    write_all(fd, "\n", 1);
+  }
+}
+
+void
+CrashHistory::install_handler(const std::string& filename)
+{
+  std::strncpy(m_filename, filename.c_str(), sizeof(m_filename) - 1);
+  prepare_thread();
+
+  CrashHistory* expected = nullptr;
+  if (!s_installed.compare_exchange_strong(expected, this)) {
+    ers::warning(CrashDumpNotInstalled(ERS_HERE, filename, "another crash dump is already installed"));
+    return;
+  }
+
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_handler = &CrashHistory::handle_signal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESETHAND | SA_ONSTACK;
+  for (size_t i = 0; i < s_num_fatal_signals; ++i)
+    sigaction(s_fatal_signals[i], &action, &s_previous_actions[i]);
+  m_installed = true;
+}
+
+void
+CrashHistory::uninstall_handler()
+{
+  if (!m_installed)
+    return;
+  for (size_t i = 0; i < s_num_fatal_signals; ++i)
+    sigaction(s_fatal_signals[i], &s_previous_actions[i], nullptr);
+  s_installed.store(nullptr);
+  m_installed = false;
+}
+
+void
+CrashHistory::handle_signal(int sig)
+{
+  // Only async-signal-safe calls from here on: open, write, close, sigaction, raise
+  auto* history = s_installed.exchange(nullptr);
+  if (history != nullptr) {
+    int fd = ::open(history->m_filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd >= 0) {
+      history->write_to(fd);
+      ::close(fd);
+    }
+  }
+
+  // Hand the signal on to whoever was installed before us (by default, terminate)
+  for (size_t i = 0; i < s_num_fatal_signals; ++i)
+    if (s_fatal_signals[i] == sig)
+      sigaction(sig, &s_previous_actions[i], nullptr);
+  raise(sig);
+}
@@ -0,0 +1,117 @@
+/**
+ * @file DeferredOpmonService.cpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/DeferredOpmonService.hpp"
+
+#include <exception>
+#include <string>
+#include <utility>
+
+using namespace dunedaq::opmonlib;
+
+DeferredOpmonService::DeferredOpmonService(std::string service, size_t max_buffered)
+  : OpmonService(std::move(service))
+  , m_max_buffered(max_buffered)
+{}
+
+DeferredOpmonService::~DeferredOpmonService()
+{
+  if (m_thread.joinable())
+    m_thread.join();
+}
+
+void
+DeferredOpmonService::start_construction()
+{
+  std::call_once(m_started, [this] { m_thread = std::thread(&DeferredOpmonService::construct, this); });
+}
+
+bool
+DeferredOpmonService::wait()
+{
+  start_construction();
+  std::unique_lock<std::mutex> lk(m_mutex);
+  m_cv.wait(lk, [this] { return m_done; });
+  return m_service != nullptr;
+}
+
+void
+DeferredOpmonService::publish(nlohmann::json j)
+{
+  forward(false, std::move(j));
+}
+
+void
+DeferredOpmonService::publish_event(nlohmann::json j)
+{
+  forward(true, std::move(j));
+}
+
+size_t
+DeferredOpmonService::get_num_dropped() const
+{
+  std::lock_guard<std::mutex> lk(m_mutex);
+  return m_num_dropped;
+}
+
+void
+DeferredOpmonService::forward(bool event, nlohmann::json j)
+{
+  start_construction();
+  std::lock_guard<std::mutex> lk(m_mutex);
+  if (m_service) {
+    if (event)
+      m_service->publish_event(std::move(j));
+    else
+      m_service->publish(std::move(j));
+  } else if (m_done) {
+    ++m_num_dropped;
+  } else {
+    if (m_pending.size() >= m_max_buffered) {
+      m_pending.pop_front();
+      ++m_num_dropped;
+    }
+    m_pending.emplace_back(event, std::move(j));
+  }
+}
+
+void
+DeferredOpmonService::construct()
+{
+  std::shared_ptr<OpmonService> service;
+  try {
+    service = makeOpmonService(get_uri());
+  } catch (const OpmonServiceCreationFailed& e) {
+    ers::error(e);
+  } catch (const std::exception& e) {
+    ers::error(OpmonServiceCreationFailed(ERS_HERE, get_uri(), e));
+  } catch (...) { // NOLINT nothing may escape the construction thread
+    ers::error(OpmonServiceCreationFailed(ERS_HERE, get_uri() + ": unknown error"));
+  }
+
+  // Publishers wait while the backlog is handed over, so that nothing overtakes it
+  std::lock_guard<std::mutex> lk(m_mutex);
+  if (service) {
+    try {
+      for (auto& [event, j] : m_pending) {
+        if (event)
+          service->publish_event(std::move(j));
+        else
+          service->publish(std::move(j));
+      }
+    } catch (const std::exception& e) {
+      TLOG() << "Dropping opmon data published before " << get_uri() << " was ready: " << e.what();
+    }
+    m_service = std::move(service);
+  } else {
+    m_num_dropped += m_pending.size();
+  }
+  m_pending.clear();
+  m_done = true;
+  m_cv.notify_all();
+}
@@ -0,0 +1,182 @@
+/**
+ * @file EventChannel.cpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/EventChannel.hpp"
+
+#include <algorithm>
+#include <utility>
+
+using namespace dunedaq::opmonlib;
+
+namespace {
+
+const char*
+severity_name(EventSeverity s)
+{
+  switch (s) {
+    case EventSeverity::kInfo:
+      return "info";
+    case EventSeverity::kWarning:
+      return "warning";
+    case EventSeverity::kError:
+      return "error";
+  }
+  return "unknown";
+}
+
+} // namespace
+
+EventQueue::EventQueue(size_t capacity)
+{
+  size_t size = 2;
+  while (size < capacity)
+    size <<= 1;
+  m_cells.reset(new Cell[size]);
+  m_mask = size - 1;
+  for (size_t i = 0; i < size; ++i)
+    m_cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+EventQueue&
+EventQueue::get()
+{
+  static EventQueue queue;
+  return queue;
+}
+
+bool
+EventQueue::push(OpmonEvent&& e)
+{
+  Cell* cell;
+  size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+  for (;;) {
+    cell = &m_cells[pos & m_mask];
+    auto seq = cell->sequence.load(std::memory_order_acquire);
+    auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+  cell->event = std::move(e);
+  cell->sequence.store(pos + 1, std::memory_order_release);
+  m_wait_cv.notify_one();
+  return true;
+}
+
+bool
+EventQueue::pop(OpmonEvent& e)
+{
+  Cell& cell = m_cells[m_dequeue_pos & m_mask];
+  if (cell.sequence.load(std::memory_order_acquire) != m_dequeue_pos + 1)
+    return false;
+  e = std::move(cell.event);
+  cell.sequence.store(m_dequeue_pos + m_mask + 1, std::memory_order_release);
+  ++m_dequeue_pos;
+  return true;
+}
+
+void
+EventQueue::wait(std::chrono::milliseconds timeout)
+{
+  // Producers notify without taking the mutex, so a wakeup can be missed;
+  // the timeout bounds the extra latency in that case.
+  std::unique_lock<std::mutex> lk(m_wait_mutex);
+  m_wait_cv.wait_for(lk, timeout, [this] {
+    return m_cells[m_dequeue_pos & m_mask].sequence.load(std::memory_order_acquire) == m_dequeue_pos + 1;
+  });
+}
+
+bool
+dunedaq::opmonlib::emit_event(std::string source, std::string type, std::string message, EventSeverity severity)
+{
+  OpmonEvent e;
+  e.source = std::move(source);
+  e.type = std::move(type);
+  e.message = std::move(message);
+  e.severity = severity;
+  e.time_ns =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  return EventQueue::get().push(std::move(e));
+}
+
+EventThrottle::EventThrottle(double rate_hz, double burst, std::chrono::milliseconds window)
+  : m_rate_hz(rate_hz)
+  , m_burst(burst)
+  , m_window(window)
+  , m_tokens(burst)
+  , m_last_refill(clock_t::now())
+{}
+
+void
+EventThrottle::offer(OpmonEvent&& e, std::vector<nlohmann::json>& out)
+{
+  auto now = clock_t::now();
+  std::string key = e.source + '\0' + e.type;
+  auto it = m_keys.find(key);
+  if (it != m_keys.end() && now - it->second.last_sent < m_window) {
+    ++it->second.suppressed;
+    it->second.latest = std::move(e);
+    return;
+  }
+  auto& state = m_keys[key];
+  state.last_sent = now;
+  send(e, 1, now, out);
+}
+
+void
+EventThrottle::flush(std::vector<nlohmann::json>& out, bool all)
+{
+  auto now = clock_t::now();
+  for (auto it = m_keys.begin(); it != m_keys.end();) {
+    auto& state = it->second;
+    if (!all && now - state.last_sent < m_window) {
+      ++it;
+    } else if (state.suppressed > 0) {
+      state.last_sent = now;
+      send(state.latest, state.suppressed, now, out);
+      state.suppressed = 0;
+      ++it;
+    } else {
+      it = m_keys.erase(it);
+    }
+  }
+}
+
+void
+EventThrottle::send(const OpmonEvent& e,
+                    uint64_t count, // NOLINT(build/unsigned)
+                    clock_t::time_point now,
+                    std::vector<nlohmann::json>& out)
+{
+  m_tokens = std::min(m_burst, m_tokens + m_rate_hz * std::chrono::duration<double>(now - m_last_refill).count());
+  m_last_refill = now;
+  if (m_tokens < 1.) {
+    m_dropped += count;
+    return;
+  }
+  m_tokens -= 1.;
+
+  nlohmann::json j;
+  j["source"] = e.source;
+  j["type"] = e.type;
+  j["severity"] = severity_name(e.severity);
+  j["message"] = e.message;
+  j["time_ns"] = e.time_ns;
+  j["count"] = count;
+  if (m_dropped > 0) {
+    j["dropped_before"] = m_dropped;
+    m_dropped = 0;
+  }
+  out.push_back(std::move(j));
+}
@@ -0,0 +1,150 @@
+/**
+ * @file InfoCollector.cpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/InfoCollector.hpp"
+
+#include "opmonlib/InfoProvider.hpp"
+#include "opmonlib/Metrics.hpp"
+#include "opmonlib/Tracing.hpp"
+
+#include <ctime>
+#include <string>
+#include <utility>
+
+using namespace dunedaq::opmonlib;
+
+OPMONLIB_PROBE_SEMAPHORE(provider_begin);
+OPMONLIB_PROBE_SEMAPHORE(provider_end);
+
+void
+InfoCollector::add(std::string name, InfoCollector& ic)
+{
+  // Children filled by hand without the context of the gather can only be filtered once they have been gathered
+  auto decision = PathFilter::Decision::kAccept;
+  if (m_context) {
+    decision = m_context->filter(child_path(name));
+    if (decision == PathFilter::Decision::kPrune)
+      return;
+  }
+  auto& infos = m_infos[s_children_tag][name];
+  infos = ic.get_collected_infos();
+  if (decision == PathFilter::Decision::kDescend)
+    infos.erase(s_prop_tag);
+  if (m_context && !ic.m_context)
+    filter_children(*m_context, child_path(name), infos);
+  if (!m_level_overridden)
+    merge_leveled(name, ic.m_leveled);
+  added(s_children_tag, name);
+}
+
+void
+InfoCollector::add(std::string name, InfoProvider& provider, int level)
+{
+  std::string path = child_path(name);
+  auto decision = PathFilter::Decision::kAccept;
+  bool overridden = m_level_overridden;
+  if (m_context) {
+    decision = m_context->filter(path);
+    if (decision == PathFilter::Decision::kPrune)
+      return;
+    overridden = overridden || m_context->overrides_level(path);
+    level = m_context->level_for(path, level);
+  }
+
+  InfoCollector child(m_context, std::move(path));
+  child.m_level_overridden = overridden;
+  int64_t t0 = OPMONLIB_PROBE_ENABLED(provider_end) ? tracing::now_ns() : 0;
+  OPMONLIB_PROBE2(provider_begin, child.get_path().c_str(), level);
+  provider.gather_stats(child, level);
+  if (OPMONLIB_PROBE_ENABLED(provider_end))
+    OPMONLIB_PROBE3(provider_end, child.get_path().c_str(), level, tracing::now_ns() - t0);
+  if (decision == PathFilter::Decision::kDescend)
+    child.m_infos.erase(s_prop_tag);
+  if (child.is_empty())
+    return;
+  m_infos[s_children_tag][name] = std::move(child.m_infos);
+  merge_leveled(name, child.m_leveled);
+  added(s_children_tag, name);
+}
+
+InfoCollector
+InfoCollector::child(const std::string& name) const
+{
+  InfoCollector c(m_context, child_path(name));
+  c.m_level_overridden = m_level_overridden || (m_context && m_context->overrides_level(c.m_path));
+  return c;
+}
+
+int
+InfoCollector::level_for(const std::string& name, int level) const
+{
+  return m_context ? m_context->level_for(child_path(name), level) : level;
+}
+
+void
+InfoCollector::filter_children(const GatherContext& context, const std::string& path, nlohmann::json& infos)
+{
+  auto children = infos.find(s_children_tag);
+  if (children == infos.end() || !children->is_object())
+    return;
+  for (auto it = children->begin(); it != children->end();) {
+    auto child = path + '.' + it.key();
+    auto decision = context.filter(child);
+    if (decision == PathFilter::Decision::kPrune) {
+      it = children->erase(it);
+      continue;
+    }
+    if (decision == PathFilter::Decision::kDescend)
+      it->erase(s_prop_tag);
+    filter_children(context, child, *it);
+    ++it;
+  }
+}
+
+void
+InfoCollector::merge_leveled(const std::string& name, const Leveled& child)
+{
+  for (auto& [location, level] : child)
+    m_leveled.emplace_back(nlohmann::json::json_pointer() / s_children_tag / name / location, level);
+}
+
+void
+InfoCollector::add(const Counter& counter)
+{
+  nlohmann::json j_infoblock;
+  j_infoblock[s_time_tag] = std::time(nullptr);
+  j_infoblock[s_data_tag] = { { "count", counter.get_value() } };
+
+  m_infos[s_prop_tag][counter.get_name()] = std::move(j_infoblock);
+  added(s_prop_tag, counter.get_name());
+}
+
+void
+InfoCollector::add(const Gauge& gauge)
+{
+  nlohmann::json j_infoblock;
+  j_infoblock[s_time_tag] = std::time(nullptr);
+  j_infoblock[s_data_tag] = { { "value", gauge.get_value() } };
+
+  m_infos[s_prop_tag][gauge.get_name()] = std::move(j_infoblock);
+  added(s_prop_tag, gauge.get_name());
+}
+
+void
+InfoCollector::add(const Histogram& histogram)
+{
+  auto stats = histogram.get_stats();
+  nlohmann::json j_infoblock;
+  j_infoblock[s_time_tag] = std::time(nullptr);
+  j_infoblock[s_data_tag] = { { "count", stats.count }, { "sum", stats.sum }, { "mean", stats.mean },
+                              { "max", stats.max },     { "p50", stats.p50 }, { "p90", stats.p90 },
+                              { "p99", stats.p99 } };
+
+  m_infos[s_prop_tag][histogram.get_name()] = std::move(j_infoblock);
+  added(s_prop_tag, histogram.get_name());
+}
@@ -8,36 +8,401 @@
 
 #include "opmonlib/InfoManager.hpp"
 
+#include "opmonlib/DeferredOpmonService.hpp"
 #include "opmonlib/InfoCollector.hpp"
 #include "opmonlib/OpmonService.hpp"
+#include "opmonlib/Tracing.hpp"
 
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <utility>
 
 using namespace dunedaq::opmonlib;
 using namespace std;
 
+OPMONLIB_PROBE_SEMAPHORE(gather_begin);
+OPMONLIB_PROBE_SEMAPHORE(gather_end);
+OPMONLIB_PROBE_SEMAPHORE(publish_begin);
+OPMONLIB_PROBE_SEMAPHORE(publish_end);
+OPMONLIB_PROBE_SEMAPHORE_DECLARATION(serialize_begin);
+OPMONLIB_PROBE_SEMAPHORE_DECLARATION(serialize_end);
+
+namespace {
+
+// Split a comma separated list
+std::vector<std::string>
+split_list(const std::string& list)
+{
+  std::vector<std::string> items;
+  std::istringstream is(list);
+  std::string item;
+  while (std::getline(is, item, ','))
+    if (!item.empty())
+      items.push_back(item);
+  return items;
+}
+
+// Longest dot separated path both `a` and `b` are in
+std::string
+common_prefix(const std::string& a, const std::string& b)
+{
+  size_t n = 0, common = 0;
+  while (n < a.size() && n < b.size() && a[n] == b[n]) {
+    if (a[n] == '.')
+      common = n;
+    ++n;
+  }
+  if ((n == a.size() || a[n] == '.') && (n == b.size() || b[n] == '.'))
+    common = n;
+  return a.substr(0, common);
+}
+
+// Whole non-negative decimal number up to `max`; throws std::invalid_argument or std::out_of_range
+uint64_t // NOLINT(build/unsigned)
+parse_number(const std::string& text, uint64_t max) // NOLINT(build/unsigned)
+{
+  if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos)
+    throw std::invalid_argument("'" + text + "' is not a non-negative integer");
+  auto value = std::stoull(text);
+  if (value > max)
+    throw std::out_of_range("'" + text + "' is larger than " + std::to_string(max));
+  return value;
+}
+
+} // namespace
+
 InfoManager::InfoManager(std::string service)
 {
-  m_service = opmonlib::makeOpmonService(service);
+  // Path filters and deferred creation are handled here, the service only sees the other query parameters
+  bool deferred = false;
+  auto query = service.find('?');
+  if (query != std::string::npos) {
+    std::vector<std::string> include, exclude;
+    std::string rest;
+    std::istringstream is(service.substr(query + 1));
+    std::string param;
+    while (std::getline(is, param, '&')) {
+      auto eq = param.find('=');
+      auto key = param.substr(0, eq);
+      auto value = eq == std::string::npos ? std::string() : param.substr(eq + 1);
+      if (key == "include") {
+        for (auto& p : split_list(value))
+          include.push_back(p);
+      } else if (key == "exclude") {
+        for (auto& p : split_list(value))
+          exclude.push_back(p);
+      } else if (key == "deferred") {
+        deferred = value.empty() || value == "1" || value == "true";
+      } else if (!param.empty()) {
+        rest += (rest.empty() ? "?" : "&") + param;
+      }
+    }
+    set_path_filter(include, exclude);
+    service.replace(query, std::string::npos, rest);
+  }
+  if (deferred) {
+    m_deferred_service = std::make_shared<DeferredOpmonService>(service);
+    m_service = m_deferred_service;
+  } else {
+    m_service = opmonlib::makeOpmonService(service);
+  }
+  m_routes.push_back({ 0, INT_MAX, "", m_service, std::make_shared<std::mutex>() });
   m_running.store(false);
 }
 
+InfoManager::~InfoManager()
+{
+  if (m_control_fd >= 0) {
+    ::close(m_control_fd);
+    ::unlink(m_control_path.c_str());
+  }
+}
+
 void
 InfoManager::publish_info(int level)
 {
+  if (!accounting::enabled()) {
+    auto s = gather_snapshot(level, true);
+    check_snapshot(s.j);
+    route_snapshot(std::move(s));
+    return;
+  }
+
+  PhaseCounts counts;
+  auto c0 = accounting::thread_counts();
+  auto t0 = std::chrono::steady_clock::now();
+  auto s = gather_snapshot(level, true);
+  auto c1 = accounting::thread_counts();
+  auto t1 = std::chrono::steady_clock::now();
+  check_snapshot(s.j);
+  counts.serialize_time = route_snapshot(std::move(s));
+  counts.gather = c1 - c0;
+  counts.publish = accounting::thread_counts() - c1;
+  counts.gather_time = t1 - t0;
+  counts.publish_time = std::chrono::steady_clock::now() - t1;
+  std::lock_guard<std::mutex> lk(m_phase_mutex);
+  m_phase_counts = counts;
+}
+
+InfoManager::PhaseCounts
+InfoManager::get_phase_counts() const
+{
+  std::lock_guard<std::mutex> lk(m_phase_mutex);
+  return m_phase_counts;
+}
 
-  nlohmann::json j = gather_info(level);
+InfoManager::Snapshot
+InfoManager::gather_snapshot(int level, bool for_rules)
+{
+  std::vector<Route> routes;
+  {
+    std::lock_guard<std::mutex> lk(m_service_mutex);
+    routes = m_routes;
+  }
 
-  m_service->publish(j);
+  // One gather at the highest level wanted, restricted to what the prefixes have in common
+  Snapshot s;
+  s.level = level;
+  bool wanted = false;
+  for (auto& r : routes) {
+    if (level < r.min_level)
+      continue;
+    int gathered_level = std::min(level, r.max_level);
+    s.gathered_level = wanted ? std::max(s.gathered_level, gathered_level) : gathered_level;
+    s.prefix = wanted ? common_prefix(s.prefix, r.prefix) : r.prefix;
+    wanted = true;
+  }
+  // Rules see the same snapshot, so it also covers the nodes they read
+  if (wanted && for_rules)
+    for (auto& path : m_rules.get_paths())
+      s.prefix = common_prefix(s.prefix, path);
+  if (wanted)
+    s.j = gather_info(s.gathered_level, s.prefix, &s.leveled);
+  return s;
+}
+
+nlohmann::json
+InfoManager::make_view(const Snapshot& s, int level, const std::string& prefix)
+{
+  nlohmann::json view;
+  if (prefix == s.prefix) {
+    view = s.j;
+  } else {
+    for (auto& [key, value] : s.j.items())
+      if (key != s_parent_tag)
+        view[key] = value;
+    auto node = node_pointer(prefix);
+    if (s.j.contains(node))
+      view[node] = s.j[node];
+    else
+      view[s_parent_tag] = {};
+  }
+  if (level >= s.gathered_level)
+    return view;
+
+  for (auto& [location, l] : s.leveled) {
+    if (l <= level || !view.contains(location))
+      continue;
+    auto parent = location.parent_pointer();
+    auto& container = view[parent];
+    container.erase(location.back());
+    // A block left without data, e.g. all its gauges removed, goes too
+    if (container.empty() && !parent.empty() && parent.back() == dunedaq::opmonlib::InfoCollector::s_data_tag) {
+      auto block = parent.parent_pointer();
+      view[block.parent_pointer()].erase(block.back());
+    }
+  }
+  return view;
+}
+
+std::chrono::nanoseconds
+InfoManager::route_snapshot(Snapshot s)
+{
+  std::chrono::nanoseconds serialize_time{ 0 };
+  if (s.j.is_null())
+    return serialize_time;
+
+  std::vector<Route> routes;
+  {
+    std::lock_guard<std::mutex> lk(m_service_mutex);
+    routes = m_routes;
+  }
+
+  // Routes sharing a level and prefix are sent the same view
+  std::map<std::pair<int, std::string>, std::vector<Route>> groups;
+  for (auto& r : routes) {
+    if (s.level < r.min_level)
+      continue;
+    groups[{ std::min(s.level, r.max_level), r.prefix }].push_back(r);
+  }
+
+  // Each service is locked only while it publishes, so that an event for one service
+  // does not wait for the snapshot of another
+  for (auto it = groups.begin(); it != groups.end(); ++it) {
+    auto& [level, prefix] = it->first;
+    bool whole = level >= s.gathered_level && prefix == s.prefix;
+    nlohmann::json j = whole && std::next(it) == groups.end() ? std::move(s.j) : make_view(s, level, prefix);
+    auto& group = it->second;
+
+    // The view is serialized once for all the services of a format
+    std::vector<std::string> formats(group.size());
+    std::map<std::string, std::string> texts;
+    size_t last_unserialized = group.size();
+    for (size_t i = 0; i < group.size(); ++i) {
+      formats[i] = group[i].service->get_format();
+      if (!formats[i].empty() && texts.count(formats[i]) == 0) {
+        int64_t t0 = OPMONLIB_PROBE_ENABLED(serialize_end) ? tracing::now_ns() : 0;
+        OPMONLIB_PROBE1(serialize_begin, formats[i].c_str());
+        auto start = std::chrono::steady_clock::now();
+        std::string text;
+        bool known = serialize_snapshot(formats[i], j, text);
+        serialize_time += std::chrono::steady_clock::now() - start;
+        if (known)
+          texts.emplace(formats[i], std::move(text));
+        else
+          formats[i].clear();
+        if (OPMONLIB_PROBE_ENABLED(serialize_end) && !formats[i].empty())
+          OPMONLIB_PROBE3(serialize_end, formats[i].c_str(), texts[formats[i]].size(), tracing::now_ns() - t0);
+      }
+      if (formats[i].empty())
+        last_unserialized = i;
+    }
+
+    for (size_t i = 0; i < group.size(); ++i) {
+      auto& uri = group[i].service->get_uri();
+      int64_t t0 = OPMONLIB_PROBE_ENABLED(publish_end) ? tracing::now_ns() : 0;
+      OPMONLIB_PROBE1(publish_begin, uri.c_str());
+      std::lock_guard<std::mutex> lk(*group[i].lock);
+      if (!formats[i].empty())
+        group[i].service->publish_serialized(texts[formats[i]]);
+      else if (i != last_unserialized)
+        group[i].service->publish(j);
+      else
+        group[i].service->publish(std::move(j));
+      if (OPMONLIB_PROBE_ENABLED(publish_end))
+        OPMONLIB_PROBE2(publish_end, uri.c_str(), tracing::now_ns() - t0);
+    }
+  }
+  return serialize_time;
+}
+
+void
+InfoManager::check_snapshot(nlohmann::json& j)
+{
+  if (j.is_null())
+    return;
+
+  // Alarms go out before the snapshot they were raised on
+  std::vector<nlohmann::json> alarms;
+  if (!m_rules.empty())
+    m_rules.evaluate(j[s_parent_tag], alarms);
+
+  for (auto& alarm : alarms) {
+    if (alarm["state"] == "raised" && m_history_depth > 0)
+      trigger_burst();
+    nlohmann::json j_alarm;
+    j_alarm[s_event_tag] = std::move(alarm);
+    publish_event(std::move(j_alarm));
+  }
+
+  record_crash_history(j);
+}
+
+void
+InfoManager::record_crash_history(const nlohmann::json& j)
+{
+  std::lock_guard<std::mutex> lk(m_service_mutex);
+  if (m_crash_history)
+    m_crash_history->record(j);
+}
+
+void
+InfoManager::publish_event(nlohmann::json j)
+{
+  // Events go to every distinct service in the routing table; a service publishing a
+  // snapshot is waited for, but the routing table is not held meanwhile
+  std::vector<Route> services;
+  {
+    std::lock_guard<std::mutex> lk(m_service_mutex);
+    for (auto& r : m_routes)
+      if (std::none_of(services.begin(), services.end(), [&](auto& s) { return s.service == r.service; }))
+        services.push_back(r);
+  }
+  for (auto& r : services) {
+    std::lock_guard<std::mutex> lk(*r.lock);
+    r.service->publish_event(j);
+  }
+}
+
+void
+InfoManager::add_route(int min_level, int max_level, const std::string& prefix, const std::string& service)
+{
+  add_route(min_level, max_level, prefix, opmonlib::makeOpmonService(service));
+}
+
+void
+InfoManager::add_route(int min_level,
+                       int max_level,
+                       const std::string& prefix,
+                       std::shared_ptr<OpmonService> service)
+{
+  std::lock_guard<std::mutex> lk(m_service_mutex);
+  auto same = std::find_if(m_routes.begin(), m_routes.end(), [&](auto& r) { return r.service == service; });
+  auto lock = same != m_routes.end() ? same->lock : std::make_shared<std::mutex>();
+  m_routes.push_back({ min_level, max_level, prefix, std::move(service), std::move(lock) });
+}
+
+void
+InfoManager::set_default_route(int min_level, int max_level, const std::string& prefix)
+{
+  std::lock_guard<std::mutex> lk(m_service_mutex);
+  m_routes.front().min_level = min_level;
+  m_routes.front().max_level = max_level;
+  m_routes.front().prefix = prefix;
 }
 
 nlohmann::json
 InfoManager::gather_info(int level)
 {
+  return gather_info(level, "");
+}
+
+nlohmann::json
+InfoManager::gather_info(int level, const std::string& prefix)
+{
+  return gather_info(level, prefix, nullptr);
+}
+
+nlohmann::json
+InfoManager::gather_info(int level, const std::string& prefix, InfoCollector::Leveled* leveled)
+{
+  int64_t t0 = OPMONLIB_PROBE_ENABLED(gather_end) ? tracing::now_ns() : 0;
+  OPMONLIB_PROBE2(gather_begin, prefix.c_str(), level);
 
   nlohmann::json j_info, j_parent;
-  dunedaq::opmonlib::InfoCollector ic;
+  auto context = get_context();
+  if (!prefix.empty()) {
+    auto restricted = std::make_shared<GatherContext>(*context);
+    restricted->set_prefix(prefix);
+    context = std::move(restricted);
+  }
+  dunedaq::opmonlib::InfoCollector ic(context, "");
   // FIXME: check against nullptr!
   m_ip->gather_stats(ic, level);
   j_info = ic.get_collected_infos();
@@ -45,9 +410,123 @@ InfoManager::gather_info(int level)
   j_parent[s_parent_tag] = {};
   j_parent[s_parent_tag].swap(j_info[dunedaq::opmonlib::InfoCollector::s_children_tag]);
 
+  if (leveled) {
+    // Below the parent tag rather than the children of the top collector, whose own infos are not kept
+    static const std::string s_children_prefix = std::string("/") + InfoCollector::s_children_tag + '/';
+    for (auto& [location, l] : ic.get_leveled()) {
+      auto pointer = location.to_string();
+      if (pointer.compare(0, s_children_prefix.size(), s_children_prefix) != 0)
+        continue;
+      pointer.replace(0, s_children_prefix.size() - 1, std::string("/") + s_parent_tag);
+      leveled->emplace_back(nlohmann::json::json_pointer(pointer), l);
+    }
+  }
+
+  sample_gauges(j_parent, level, *context, leveled);
+
+  if (OPMONLIB_PROBE_ENABLED(gather_end))
+    OPMONLIB_PROBE3(gather_end, prefix.c_str(), level, tracing::now_ns() - t0);
   return j_parent;
 }
 
+nlohmann::json::json_pointer
+InfoManager::node_pointer(const std::string& path)
+{
+  nlohmann::json::json_pointer node;
+  node /= s_parent_tag;
+  bool top = true;
+  size_t start = 0;
+  while (start <= path.size()) {
+    auto end = path.find('.', start);
+    if (end == std::string::npos)
+      end = path.size();
+    if (!top)
+      node /= dunedaq::opmonlib::InfoCollector::s_children_tag;
+    node /= path.substr(start, end - start);
+    top = false;
+    start = end + 1;
+  }
+  return node;
+}
+
+nlohmann::json::json_pointer
+InfoManager::info_block_pointer(const std::string& path, const std::string& info_type)
+{
+  return node_pointer(path) / dunedaq::opmonlib::InfoCollector::s_prop_tag / info_type;
+}
+
+InfoManager::GaugeId
+InfoManager::add_gauge(const std::string& path,
+                       const std::string& info_type,
+                       const std::string& field,
+                       GaugeFunction gauge,
+                       int level)
+{
+  auto g = std::make_shared<Gauge>();
+  g->level = level;
+  g->path = path;
+  // Resolve the path to a json pointer once, so that sampling does not parse it again
+  g->block = info_block_pointer(path, info_type);
+  g->field = field;
+  g->function = std::move(gauge);
+
+  std::lock_guard<std::mutex> lk(m_gauge_mutex);
+  g->id = m_next_gauge_id++;
+  m_gauges.push_back(g);
+  return g->id;
+}
+
+bool
+InfoManager::remove_gauge(GaugeId id)
+{
+  std::shared_ptr<Gauge> g;
+  {
+    std::lock_guard<std::mutex> lk(m_gauge_mutex);
+    auto it = std::find_if(m_gauges.begin(), m_gauges.end(), [id](auto& e) { return e->id == id; });
+    if (it == m_gauges.end())
+      return false;
+    g = *it;
+    m_gauges.erase(it);
+  }
+  g->removed = true;
+  // Wait for a sampling in progress, unless called from one of the gauge functions
+  if (m_gauge_sampling_thread.load() != std::this_thread::get_id()) {
+    std::lock_guard<std::mutex> wait(m_gauge_sampling_mutex);
+  }
+  return true;
+}
+
+void
+InfoManager::sample_gauges(nlohmann::json& j,
+                           int level,
+                           const GatherContext& context,
+                           InfoCollector::Leveled* leveled)
+{
+  // The list is copied under the sampling lock, so that a gauge removed after the copy
+  // has its removal wait for the end of this sampling
+  std::lock_guard<std::mutex> sampling(m_gauge_sampling_mutex);
+  std::vector<std::shared_ptr<Gauge>> gauges;
+  {
+    std::lock_guard<std::mutex> lk(m_gauge_mutex);
+    if (m_gauges.empty())
+      return;
+    gauges = m_gauges;
+  }
+  m_gauge_sampling_thread = std::this_thread::get_id();
+  auto now = std::time(nullptr);
+  for (auto& g : gauges) {
+    if (g->removed || g->level > context.level_for(g->path, level) ||
+        context.filter(g->path) != PathFilter::Decision::kAccept)
+      continue;
+    auto& block = j[g->block];
+    block[dunedaq::opmonlib::InfoCollector::s_time_tag] = now;
+    block[dunedaq::opmonlib::InfoCollector::s_data_tag][g->field] = g->function();
+    if (leveled && g->level > 0 && !context.overrides_level(g->path))
+      leveled->emplace_back(g->block / dunedaq::opmonlib::InfoCollector::s_data_tag / g->field, g->level);
+  }
+  m_gauge_sampling_thread = std::thread::id();
+}
+
 void
 InfoManager::set_provider(opmonlib::InfoProvider& p)
 {
@@ -56,32 +535,362 @@ InfoManager::set_provider(opmonlib::InfoProvider& p)
   m_ip = &p;
 }
 
+void
+InfoManager::add_rules(const nlohmann::json& config)
+{
+  m_rules.add_rules(config);
+}
+
 void
 InfoManager::start(uint32_t interval_sec, uint32_t level) // NOLINT(build/unsigned)
 {
+  if (m_deferred_service)
+    m_deferred_service->start_construction();
+  m_level.store(level);
+  m_interval_sec.store(interval_sec);
   m_running.store(true);
-  if (interval_sec > 0)
-    m_thread = std::thread(&InfoManager::run, this, interval_sec, level);
+  // Events are forwarded even when snapshots are only published by explicit calls
+  m_event_thread = std::thread(&InfoManager::run_events, this);
+  if (interval_sec > 0) {
+    m_thread = std::thread(&InfoManager::run, this);
+    if (m_control_fd >= 0)
+      m_control_thread = std::thread(&InfoManager::run_control, this);
+  }
 }
 
 void
-InfoManager::run(uint32_t interval_sec, uint32_t level) // NOLINT(build/unsigned)
+InfoManager::set_level(uint32_t level) // NOLINT(build/unsigned)
 {
-  uint32_t countdown = 10 * interval_sec; // NOLINT(build/unsigned)
-  while (m_running.load()) {
-    if (countdown > 0) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
-      --countdown;
+  m_level.store(level);
+}
+
+void
+InfoManager::set_interval(uint32_t interval_sec) // NOLINT(build/unsigned)
+{
+  {
+    std::lock_guard<std::mutex> lk(m_run_mutex);
+    m_interval_sec.store(interval_sec);
+  }
+  m_run_cv.notify_all();
+}
+
+void
+InfoManager::set_level(const std::string& path, int level)
+{
+  // Copy on write, so that a gather in progress keeps a consistent view
+  std::lock_guard<std::mutex> lk(m_context_mutex);
+  auto context = std::make_shared<GatherContext>(*m_context);
+  context->set_level(path, level);
+  m_context = std::move(context);
+}
+
+void
+InfoManager::clear_level(const std::string& path)
+{
+  std::lock_guard<std::mutex> lk(m_context_mutex);
+  auto context = std::make_shared<GatherContext>(*m_context);
+  context->clear_level(path);
+  m_context = std::move(context);
+}
+
+void
+InfoManager::set_path_filter(const std::vector<std::string>& include, const std::vector<std::string>& exclude)
+{
+  std::lock_guard<std::mutex> lk(m_context_mutex);
+  auto context = std::make_shared<GatherContext>(*m_context);
+  context->get_filter() = PathFilter();
+  for (auto& p : include)
+    context->get_filter().include(p);
+  for (auto& p : exclude)
+    context->get_filter().exclude(p);
+  m_context = std::move(context);
+}
+
+std::shared_ptr<const GatherContext>
+InfoManager::get_context()
+{
+  std::lock_guard<std::mutex> lk(m_context_mutex);
+  return m_context;
+}
+
+void
+InfoManager::open_control_socket(const std::string& path)
+{
+  if (m_control_fd >= 0) {
+    ers::error(ControlSocketFailed(ERS_HERE, path, "a control socket is already open at " + m_control_path));
+    return;
+  }
+
+  // A socket left behind by a previous run is replaced, anything else is left alone
+  struct stat st;
+  if (::lstat(path.c_str(), &st) == 0 && !S_ISSOCK(st.st_mode)) {
+    ers::error(ControlSocketFailed(ERS_HERE, path, "exists and is not a socket"));
+    return;
+  }
+
+  // Commands change what is published: only the owner may send them. The socket is bound in a
+  // private directory next to `path`, restricted, and then moved into place, so that it is never
+  // reachable with the permissions of the umask.
+  auto slash = path.rfind('/');
+  std::string dir = slash == std::string::npos ? "." : path.substr(0, std::max<size_t>(slash, 1));
+  std::string private_dir = dir + "/.opmon_control.XXXXXX";
+  if (::mkdtemp(private_dir.data()) == nullptr) {
+    ers::error(ControlSocketFailed(ERS_HERE, path, std::strerror(errno)));
+    return;
+  }
+  std::string private_path = private_dir + "/socket";
+
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  int fd = -1;
+  auto fail = [&](const std::string& reason) {
+    ers::error(ControlSocketFailed(ERS_HERE, path, reason));
+    if (fd >= 0)
+      ::close(fd);
+    ::unlink(private_path.c_str());
+    ::rmdir(private_dir.c_str());
+  };
+  if (private_path.size() >= sizeof(addr.sun_path))
+    return fail("path too long");
+  std::strncpy(addr.sun_path, private_path.c_str(), sizeof(addr.sun_path) - 1);
+
+  fd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return fail(std::strerror(errno));
+  if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) // NOLINT
+    return fail(std::strerror(errno));
+  if (::chmod(private_path.c_str(), S_IRUSR | S_IWUSR) < 0 || ::rename(private_path.c_str(), path.c_str()) < 0)
+    return fail(std::strerror(errno));
+  ::rmdir(private_dir.c_str());
+
+  m_control_fd = fd;
+  m_control_path = path;
+  if (m_running.load() && m_thread.joinable() && !m_control_thread.joinable())
+    m_control_thread = std::thread(&InfoManager::run_control, this);
+}
+
+std::string
+InfoManager::handle_command(const std::string& command)
+{
+  std::istringstream is(command);
+  std::string verb, arg1, arg2;
+  is >> verb >> arg1 >> arg2;
+  try {
+    if (verb == "level" && !arg1.empty() && arg2.empty()) {
+      set_level(static_cast<uint32_t>(parse_number(arg1, std::numeric_limits<uint32_t>::max()))); // NOLINT
+    } else if (verb == "level" && !arg2.empty()) {
+      set_level(arg1, static_cast<int>(parse_number(arg2, std::numeric_limits<int>::max())));
+    } else if (verb == "clear" && !arg1.empty()) {
+      clear_level(arg1);
+    } else if (verb == "interval" && !arg1.empty()) {
+      set_interval(static_cast<uint32_t>(parse_number(arg1, std::numeric_limits<uint32_t>::max()))); // NOLINT
+    } else if (verb == "status") {
+      nlohmann::json j;
+      j["level"] = m_level.load();
+      j["interval_sec"] = m_interval_sec.load();
+      j["overrides"] = get_context()->get_level_overrides();
+      return j.dump();
     } else {
+      return "error: unknown command '" + command + "'";
+    }
+  } catch (const std::exception& e) {
+    return std::string("error: ") + e.what();
+  }
+  return "ok";
+}
+
+void
+InfoManager::run_control()
+{
+  char buffer[1024];
+  while (m_running.load()) {
+    pollfd pfd{ m_control_fd, POLLIN, 0 };
+    if (::poll(&pfd, 1, 100) <= 0)
+      continue;
+    sockaddr_un peer;
+    socklen_t peer_len = sizeof(peer);
+    auto n = ::recvfrom(
+      m_control_fd, buffer, sizeof(buffer) - 1, 0, reinterpret_cast<sockaddr*>(&peer), &peer_len); // NOLINT
+    if (n <= 0)
+      continue;
+    std::string command(buffer, static_cast<size_t>(n));
+    while (!command.empty() && (command.back() == '\n' || command.back() == '\r'))
+      command.pop_back();
+    TLOG() << "Opmon control command: " << command;
+    auto reply = handle_command(command);
+    if (peer_len > sizeof(sa_family_t))
+      ::sendto(m_control_fd, reply.data(), reply.size(), 0, reinterpret_cast<sockaddr*>(&peer), peer_len); // NOLINT
+  }
+}
+
+void
+InfoManager::set_event_limits(double rate_hz, double burst, std::chrono::milliseconds coalescing_window)
+{
+  std::lock_guard<std::mutex> lk(m_event_throttle_mutex);
+  m_event_throttle = EventThrottle(rate_hz, burst, coalescing_window);
+}
+
+void
+InfoManager::enable_history(std::chrono::milliseconds period,
+                            std::chrono::seconds depth,
+                            std::chrono::seconds burst_duration)
+{
+  m_history_period = period;
+  m_history_depth = period.count() > 0 ? std::chrono::milliseconds(depth).count() / period.count() : 0;
+  m_burst_duration = burst_duration;
+}
+
+void
+InfoManager::trigger_burst()
+{
+  trigger_burst(m_burst_duration);
+}
+
+void
+InfoManager::trigger_burst(std::chrono::seconds duration)
+{
+  m_burst_request_ms.store(std::chrono::milliseconds(duration).count());
+  m_run_cv.notify_all();
+}
+
+void
+InfoManager::enable_crash_dump(const std::string& filename, size_t num_snapshots, size_t max_bytes)
+{
+  std::lock_guard<std::mutex> lk(m_service_mutex);
+  m_crash_history = std::make_unique<CrashHistory>(num_snapshots, max_bytes);
+  m_crash_history->install_handler(filename);
+}
+
+void
+InfoManager::stamp_burst(nlohmann::json& j, bool from_history)
+{
+  j[s_burst_tag]["time_ns"] =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  j[s_burst_tag]["history"] = from_history;
+}
+
+void
+InfoManager::run()
+{
+  using clock = std::chrono::steady_clock;
+  const bool history = m_history_depth > 0;
+  {
+    // Providers are called on this thread
+    std::lock_guard<std::mutex> lk(m_service_mutex);
+    if (m_crash_history)
+      CrashHistory::prepare_thread();
+  }
+  auto last_publish = clock::now();
+  auto next_sample = history ? clock::now() + m_history_period : clock::time_point::max();
+  auto burst_until = clock::time_point::min();
+
+  while (m_running.load()) {
+    // Level and interval are re-read every cycle, so changes apply at the next deadline
+    auto interval_sec = m_interval_sec.load();
+    auto next_publish =
+      interval_sec > 0 ? last_publish + std::chrono::seconds(interval_sec) : clock::time_point::max();
+    {
+      std::unique_lock<std::mutex> lk(m_run_mutex);
+      m_run_cv.wait_until(lk, std::min(next_publish, next_sample), [&] {
+        return !m_running.load() || m_burst_request_ms.load() > 0 || m_interval_sec.load() != interval_sec;
+      });
+    }
+    if (!m_running.load())
+      break;
+    auto now = clock::now();
+    int level = static_cast<int>(m_level.load());
+
+    // History and burst snapshots follow the routing table, but rules only see the regular
+    // publications: a history replayed late would break their streaks and could raise alarms again
+    auto burst_ms = m_burst_request_ms.exchange(0);
+    if (burst_ms > 0 && history) {
+      for (auto& s : m_history)
+        route_snapshot(std::move(s));
+      m_history.clear();
+      burst_until = now + std::chrono::milliseconds(burst_ms);
+    }
+
+    if (history && now >= next_sample) {
+      auto s = gather_snapshot(level, false);
+      if (s.j.is_null()) {
+        // No route wants this level
+      } else if (now < burst_until) {
+        stamp_burst(s.j, false);
+        record_crash_history(s.j);
+        route_snapshot(std::move(s));
+      } else {
+        stamp_burst(s.j, true);
+        record_crash_history(s.j);
+        m_history.push_back(std::move(s));
+        while (m_history.size() > m_history_depth)
+          m_history.pop_front();
+      }
+      next_sample += m_history_period;
+      if (next_sample < now)
+        next_sample = now + m_history_period;
+    }
+
+    if (now >= next_publish) {
       publish_info(level);
-      countdown = 10 * interval_sec;
+      last_publish = next_publish;
+      if (last_publish + std::chrono::seconds(interval_sec) < now)
+        last_publish = now;
     }
   }
 }
 
+void
+InfoManager::run_events()
+{
+  // The queue is process wide and has a single consumer; wait for another InfoManager to stop
+  auto& queue = EventQueue::get();
+  while (!queue.claim_consumer()) {
+    std::unique_lock<std::mutex> lk(m_run_mutex);
+    if (m_run_cv.wait_for(lk, std::chrono::milliseconds(100), [this] { return !m_running.load(); }))
+      return;
+  }
+
+  EventThrottle throttle;
+  {
+    std::lock_guard<std::mutex> lk(m_event_throttle_mutex);
+    throttle = m_event_throttle;
+  }
+  std::vector<nlohmann::json> ready;
+  OpmonEvent e;
+  bool running = true;
+  while (running) {
+    // After stop(), a last pass forwards what is queued and every pending repeat
+    running = m_running.load();
+    if (running)
+      queue.wait(std::chrono::milliseconds(100));
+    while (queue.pop(e))
+      throttle.offer(std::move(e), ready);
+    throttle.add_dropped(queue.get_num_dropped());
+    throttle.flush(ready, !running);
+
+    for (auto& j_event : ready) {
+      nlohmann::json j;
+      j[s_event_tag] = std::move(j_event);
+      publish_event(std::move(j));
+    }
+    ready.clear();
+  }
+  queue.release_consumer();
+}
+
 void
 InfoManager::stop()
 {
-  m_running.store(false);
-  m_thread.join();
+  {
+    std::lock_guard<std::mutex> lk(m_run_mutex);
+    m_running.store(false);
+  }
+  m_run_cv.notify_all();
+  if (m_thread.joinable())
+    m_thread.join();
+  if (m_event_thread.joinable())
+    m_event_thread.join();
+  if (m_control_thread.joinable())
+    m_control_thread.join();
 }
@@ -0,0 +1,107 @@
+/**
+ * @file LatencyProbe.cpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/LatencyProbe.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <thread>
+
+using namespace dunedaq::opmonlib;
+
+namespace {
+
+uint64_t // NOLINT(build/unsigned)
+monotonic_ns()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec; // NOLINT(build/unsigned)
+}
+
+// Reference point taken when the library is loaded. Calibration happens on first
+// use by comparing against a second reading, so no time is spent sleeping at startup.
+struct CalibrationPoint
+{
+  uint64_t ns = monotonic_ns();     // NOLINT(build/unsigned)
+  uint64_t ticks = TscClock::now(); // NOLINT(build/unsigned)
+};
+
+const CalibrationPoint s_startup_point;
+
+double
+calibrate()
+{
+#ifdef OPMONLIB_HAVE_RDTSC
+  constexpr uint64_t min_interval_ns = 10000000; // NOLINT(build/unsigned)
+  CalibrationPoint end;
+  if (end.ns - s_startup_point.ns < min_interval_ns) {
+    std::this_thread::sleep_for(std::chrono::nanoseconds(min_interval_ns - (end.ns - s_startup_point.ns)));
+    end = CalibrationPoint();
+  }
+  if (end.ticks <= s_startup_point.ticks)
+    return 1.;
+  return static_cast<double>(end.ns - s_startup_point.ns) / static_cast<double>(end.ticks - s_startup_point.ticks);
+#else
+  return 1.;
+#endif
+}
+
+} // namespace
+
+double
+TscClock::ns_per_tick() noexcept
+{
+  static const double factor = calibrate();
+  return factor;
+}
+
+LatencyStats
+LatencyProbe::get_stats() const
+{
+  std::array<uint64_t, s_num_buckets> buckets{}; // NOLINT(build/unsigned)
+  uint64_t sum = 0;                              // NOLINT(build/unsigned)
+  uint64_t min = UINT64_MAX;                     // NOLINT(build/unsigned)
+  uint64_t max = 0;                              // NOLINT(build/unsigned)
+  LatencyStats stats;
+
+  for (auto& slot : m_slots) {
+    stats.count += slot.count.load(std::memory_order_relaxed);
+    sum += slot.sum.load(std::memory_order_relaxed);
+    min = std::min(min, slot.min.load(std::memory_order_relaxed));
+    max = std::max(max, slot.max.load(std::memory_order_relaxed));
+    for (size_t i = 0; i < s_num_buckets; ++i)
+      buckets[i] += slot.buckets[i].load(std::memory_order_relaxed);
+  }
+
+  if (stats.count == 0)
+    return stats;
+
+  const double scale = TscClock::ns_per_tick();
+  stats.mean_ns = scale * static_cast<double>(sum) / static_cast<double>(stats.count);
+  stats.min_ns = scale * static_cast<double>(min);
+  stats.max_ns = scale * static_cast<double>(max);
+
+  // Percentiles are estimated at the centre of the log2 bucket, clamped to the observed range
+  auto percentile = [&](double fraction) {
+    uint64_t total = 0; // NOLINT(build/unsigned)
+    for (size_t i = 0; i < s_num_buckets; ++i) {
+      total += buckets[i];
+      if (static_cast<double>(total) >= fraction * static_cast<double>(stats.count)) {
+        double estimate = 1.5 * static_cast<double>(1ULL << i) * scale;
+        return std::clamp(estimate, stats.min_ns, stats.max_ns);
+      }
+    }
+    return stats.max_ns;
+  };
+  stats.p50_ns = percentile(0.50);
+  stats.p90_ns = percentile(0.90);
+  stats.p99_ns = percentile(0.99);
+
+  return stats;
+}
@@ -0,0 +1,12 @@
+/**
+ * @file Levels.cpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/Levels.hpp"
+
+// Code compiled with another OPMONLIB_MAX_LEVEL refers to a symbol that is not defined here
+const int dunedaq::opmonlib::levels::OPMONLIB_LEVEL_SYMBOL(OPMONLIB_MAX_LEVEL) = OPMONLIB_MAX_LEVEL;
@@ -0,0 +1,46 @@
+/**
+ * @file Metrics.cpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/Metrics.hpp"
+
+#include <algorithm>
+
+using namespace dunedaq::opmonlib;
+
+HistogramStats
+Histogram::get_stats() const
+{
+  uint64_t buckets[s_num_buckets]; // NOLINT
+  HistogramStats stats;
+  for (size_t i = 0; i < s_num_buckets; ++i) {
+    buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    stats.count += buckets[i];
+  }
+  if (stats.count == 0)
+    return stats;
+
+  stats.sum = static_cast<double>(m_sum.load(std::memory_order_relaxed));
+  stats.mean = stats.sum / static_cast<double>(stats.count);
+  stats.max = static_cast<double>(m_max.load(std::memory_order_relaxed));
+
+  // Percentiles are estimated at the centre of the bucket, clamped to the observed maximum
+  auto percentile = [&](double fraction) {
+    uint64_t total = 0; // NOLINT(build/unsigned)
+    for (size_t i = 0; i < s_num_buckets; ++i) {
+      total += buckets[i];
+      if (static_cast<double>(total) >= fraction * static_cast<double>(stats.count))
+        return i == 0 ? 0. : std::min(1.5 * static_cast<double>(1ULL << (i - 1)), stats.max);
+    }
+    return stats.max;
+  };
+  stats.p50 = percentile(0.50);
+  stats.p90 = percentile(0.90);
+  stats.p99 = percentile(0.99);
+
+  return stats;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file OpmonService.cpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/OpmonService.hpp"
+#include "opmonlib/Tracing.hpp"
+
+#include <cetlib/BasicPluginFactory.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Fired by the built-in services
+OPMONLIB_PROBE_SEMAPHORE(serialize_begin);
+OPMONLIB_PROBE_SEMAPHORE(serialize_end);
+
+namespace dunedaq::opmonlib {
+
+// Defined with each built-in service
+std::shared_ptr<OpmonService>
+make_stdout_service(const std::string& uri);
+std::shared_ptr<OpmonService>
+make_file_service(const std::string& uri);
+std::shared_ptr<OpmonService>
+make_tsfile_service(const std::string& uri);
+
+} // namespace dunedaq::opmonlib
+
+using namespace dunedaq::opmonlib;
+
+namespace {
+
+struct Registry
+{
+  std::mutex mutex;
+  std::map<std::string, OpmonServiceMaker> makers;
+};
+
+// Built-in services are listed here rather than registered by static objects, so that
+// they are available however early makeOpmonService is called
+Registry&
+registry()
+{
+  static Registry r{ {},
+                     { { "stdout", &make_stdout_service },
+                       { "file", &make_file_service },
+                       { "tsfile", &make_tsfile_service } } };
+  return r;
+}
+
+OpmonServiceMaker
+find_maker(const std::string& scheme)
+{
+  auto& r = registry();
+  std::lock_guard<std::mutex> lk(r.mutex);
+  auto it = r.makers.find(scheme);
+  return it == r.makers.end() ? nullptr : it->second;
+}
+
+} // namespace
+
+bool
+dunedaq::opmonlib::registerOpmonService(const std::string& scheme, OpmonServiceMaker maker)
+{
+  auto& r = registry();
+  std::lock_guard<std::mutex> lk(r.mutex);
+  return r.makers.emplace(scheme, maker).second;
+}
+
+std::shared_ptr<OpmonService>
+dunedaq::opmonlib::makeOpmonService(std::string const& service)
+{
+  TLOG() << "SERVICE = " << service;
+  auto sep = service.find("://");
+  std::string scheme;
+  if (sep == std::string::npos) { // simple path
+    scheme = "stdout";
+  } else { // with scheme
+    scheme = service.substr(0, sep);
+  }
+
+  // Compiled-in services need no library search and no dlopen
+  if (auto maker = find_maker(scheme)) {
+    try {
+      return maker(service);
+    } catch (const ers::Issue& iexpt) {
+      throw OpmonServiceCreationFailed(ERS_HERE, service, iexpt);
+    } catch (const std::exception& sexpt) {
+      throw OpmonServiceCreationFailed(ERS_HERE, service, sexpt);
+    } catch (...) { // NOLINT as for plugins below
+      throw OpmonServiceCreationFailed(ERS_HERE, service, "Unknown error.");
+    }
+  }
+
+  std::string plugin_name = scheme + "OpmonService";
+  static cet::BasicPluginFactory bpf("duneOpmonService", "make");
+  std::shared_ptr<OpmonService> os_ptr;
+  try {
+    os_ptr = bpf.makePlugin<std::shared_ptr<OpmonService>>(plugin_name, service);
+  } catch (const cet::exception& cexpt) {
+    throw OpmonServiceCreationFailed(ERS_HERE, service, cexpt);
+  } catch (const ers::Issue& iexpt) {
+    throw OpmonServiceCreationFailed(ERS_HERE, service, iexpt);
+  } catch (...) { // NOLINT JCF Jan-27-2021 violates letter of the law but not the spirit
+    throw OpmonServiceCreationFailed(ERS_HERE, service, "Unknown error.");
+  }
+  return os_ptr;
+}
+
+bool
+dunedaq::opmonlib::serialize_snapshot(const std::string& format, const nlohmann::json& j, std::string& text)
+{
+  if (format == "json")
+    text = j.dump();
+  else if (format == "json-indented")
+    text = j.dump(2);
+  else if (format == "json-flat")
+    text = j.flatten().dump(4);
+  else
+    return false;
+  return true;
+}
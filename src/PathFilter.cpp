@@ -0,0 +1,124 @@
+/**
+ * @file PathFilter.cpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/PathFilter.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace dunedaq::opmonlib;
+
+namespace {
+
+const std::string s_wildcard{ "*" };
+
+} // namespace
+
+PathFilter::PathFilter(const PathFilter& other)
+{
+  copy(other.m_include, m_include);
+  copy(other.m_exclude, m_exclude);
+}
+
+PathFilter&
+PathFilter::operator=(const PathFilter& other)
+{
+  if (this != &other) {
+    copy(other.m_include, m_include);
+    copy(other.m_exclude, m_exclude);
+  }
+  return *this;
+}
+
+void
+PathFilter::copy(const std::unique_ptr<Node>& from, std::unique_ptr<Node>& to)
+{
+  if (!from) {
+    to.reset();
+    return;
+  }
+  to = std::make_unique<Node>();
+  to->terminal = from->terminal;
+  for (auto& [name, child] : from->children)
+    copy(child, to->children[name]);
+}
+
+std::vector<std::string>
+PathFilter::split(const std::string& path)
+{
+  std::vector<std::string> segments;
+  if (path.empty())
+    return segments;
+  size_t start = 0;
+  while (start <= path.size()) {
+    auto end = path.find('.', start);
+    if (end == std::string::npos)
+      end = path.size();
+    segments.push_back(path.substr(start, end - start));
+    start = end + 1;
+  }
+  return segments;
+}
+
+void
+PathFilter::insert(std::unique_ptr<Node>& root, const std::string& pattern)
+{
+  if (!root)
+    root = std::make_unique<Node>();
+  Node* node = root.get();
+  for (auto& segment : split(pattern)) {
+    auto& child = node->children[segment];
+    if (!child)
+      child = std::make_unique<Node>();
+    node = child.get();
+  }
+  node->terminal = true;
+}
+
+void
+PathFilter::include(const std::string& pattern)
+{
+  insert(m_include, pattern);
+}
+
+void
+PathFilter::exclude(const std::string& pattern)
+{
+  insert(m_exclude, pattern);
+}
+
+PathFilter::Decision
+PathFilter::match(const Node& node, const std::vector<std::string>& segments, size_t depth)
+{
+  if (node.terminal)
+    return Decision::kAccept;
+  if (depth == segments.size())
+    return node.children.empty() ? Decision::kPrune : Decision::kDescend;
+
+  auto result = Decision::kPrune;
+  for (const auto* key : { &segments[depth], &s_wildcard }) {
+    auto it = node.children.find(*key);
+    if (it != node.children.end())
+      result = std::max(result, match(*it->second, segments, depth + 1));
+    if (result == Decision::kAccept)
+      break;
+  }
+  return result;
+}
+
+PathFilter::Decision
+PathFilter::check(const std::string& path) const
+{
+  auto segments = split(path);
+  if (m_exclude && match(*m_exclude, segments, 0) == Decision::kAccept)
+    return Decision::kPrune;
+  if (!m_include)
+    return Decision::kAccept;
+  return match(*m_include, segments, 0);
+}
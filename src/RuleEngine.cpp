@@ -0,0 +1,229 @@
+/**
+ * @file RuleEngine.cpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/RuleEngine.hpp"
+
+#include "opmonlib/InfoCollector.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <utility>
+
+using namespace dunedaq::opmonlib;
+
+namespace {
+
+// Keys leading to the data of info block `info_type` of the node at the dot separated `path` of a gathered tree
+std::vector<std::string>
+block_keys(const std::string& path, const std::string& info_type)
+{
+  std::vector<std::string> keys;
+  size_t start = 0;
+  while (start <= path.size()) {
+    auto end = path.find('.', start);
+    if (end == std::string::npos)
+      end = path.size();
+    if (start > 0)
+      keys.emplace_back(InfoCollector::s_children_tag);
+    keys.push_back(path.substr(start, end - start));
+    start = end + 1;
+  }
+  keys.emplace_back(InfoCollector::s_prop_tag);
+  keys.push_back(info_type);
+  keys.emplace_back(InfoCollector::s_data_tag);
+  return keys;
+}
+
+// Follow `keys` from `tree`; null if any is missing
+const nlohmann::json*
+resolve(const nlohmann::json& tree, const std::vector<std::string>& keys)
+{
+  const nlohmann::json* node = &tree;
+  for (auto& key : keys) {
+    if (!node->is_object())
+      return nullptr;
+    auto it = node->find(key);
+    if (it == node->end())
+      return nullptr;
+    node = &*it;
+  }
+  return node;
+}
+
+// Numeric view of a field of an info block; false if missing or not a number
+bool
+get_number(const nlohmann::json* block, const std::string& field, double& out)
+{
+  if (block == nullptr || !block->is_object())
+    return false;
+  auto it = block->find(field);
+  if (it == block->end())
+    return false;
+  const auto& v = *it;
+  if (v.is_number()) {
+    out = v.get<double>();
+    return true;
+  }
+  if (v.is_boolean()) {
+    out = v.get<bool>() ? 1. : 0.;
+    return true;
+  }
+  return false;
+}
+
+} // namespace
+
+void
+RuleEngine::add_rules(const nlohmann::json& config)
+{
+  if (config.is_array()) {
+    for (auto& r : config)
+      add_rule(r);
+  } else {
+    add_rule(config);
+  }
+}
+
+void
+RuleEngine::add_rule(const nlohmann::json& config)
+{
+  static const std::vector<std::pair<std::string, Comparison>> comparisons = {
+    { ">", Comparison::kGreater }, { ">=", Comparison::kGreaterEqual }, { "<", Comparison::kLess },
+    { "<=", Comparison::kLessEqual }, { "==", Comparison::kEqual },     { "!=", Comparison::kNotEqual }
+  };
+
+  Rule rule;
+  std::vector<std::string> keys;
+  try {
+    rule.name = config.at("name").get<std::string>();
+    rule.path = config.at("path").get<std::string>();
+    keys = block_keys(rule.path, config.at("info_type").get<std::string>());
+    rule.value = config.at("field").get<std::string>();
+    if (config.contains("denominator")) {
+      rule.denominator = config.at("denominator").get<std::string>();
+      rule.has_denominator = true;
+    }
+    rule.threshold = config.at("threshold").get<double>();
+    rule.cycles = config.value("cycles", 1U);
+    rule.severity = config.value("severity", std::string("warning"));
+
+    auto op = config.at("op").get<std::string>();
+    bool found = false;
+    for (auto& [symbol, comparison] : comparisons) {
+      if (symbol == op) {
+        rule.comparison = comparison;
+        found = true;
+      }
+    }
+    if (!found)
+      throw BadRule(ERS_HERE, config.dump(), "unknown comparison " + op);
+  } catch (const nlohmann::json::exception& e) {
+    throw BadRule(ERS_HERE, config.dump(), e.what());
+  }
+  if (rule.cycles == 0)
+    rule.cycles = 1;
+
+  std::lock_guard<std::mutex> lk(m_mutex);
+  auto it = std::find(m_blocks.begin(), m_blocks.end(), keys);
+  rule.block = it - m_blocks.begin();
+  if (it == m_blocks.end())
+    m_blocks.push_back(std::move(keys));
+  m_rules.push_back(std::move(rule));
+}
+
+bool
+RuleEngine::empty()
+{
+  std::lock_guard<std::mutex> lk(m_mutex);
+  return m_rules.empty();
+}
+
+std::vector<std::string>
+RuleEngine::get_paths()
+{
+  std::lock_guard<std::mutex> lk(m_mutex);
+  std::vector<std::string> paths;
+  for (auto& rule : m_rules)
+    if (std::find(paths.begin(), paths.end(), rule.path) == paths.end())
+      paths.push_back(rule.path);
+  return paths;
+}
+
+void
+RuleEngine::evaluate(const nlohmann::json& tree, std::vector<nlohmann::json>& alarms)
+{
+  std::lock_guard<std::mutex> lk(m_mutex);
+  auto now_ns =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+  m_resolved.resize(m_blocks.size());
+  for (size_t b = 0; b < m_blocks.size(); ++b)
+    m_resolved[b] = resolve(tree, m_blocks[b]);
+
+  for (auto& rule : m_rules) {
+    const auto* block = m_resolved[rule.block];
+    double value = 0.;
+    bool valid = get_number(block, rule.value, value);
+    if (valid && rule.has_denominator) {
+      double den = 0.;
+      valid = get_number(block, rule.denominator, den) && den != 0.;
+      if (valid)
+        value /= den;
+    }
+
+    bool condition = false;
+    if (valid) {
+      switch (rule.comparison) {
+        case Comparison::kGreater:
+          condition = value > rule.threshold;
+          break;
+        case Comparison::kGreaterEqual:
+          condition = value >= rule.threshold;
+          break;
+        case Comparison::kLess:
+          condition = value < rule.threshold;
+          break;
+        case Comparison::kLessEqual:
+          condition = value <= rule.threshold;
+          break;
+        case Comparison::kEqual:
+          condition = value == rule.threshold;
+          break;
+        case Comparison::kNotEqual:
+          condition = value != rule.threshold;
+          break;
+      }
+    }
+
+    rule.streak = condition ? rule.streak + 1 : 0;
+    bool raise = !rule.active && rule.streak >= rule.cycles;
+    bool clear = rule.active && !condition;
+    if (!raise && !clear)
+      continue;
+    rule.active = raise;
+
+    std::ostringstream msg;
+    msg << rule.name << (raise ? " raised" : " cleared");
+    if (valid)
+      msg << ", value " << value;
+
+    nlohmann::json alarm;
+    alarm["source"] = rule.path;
+    alarm["type"] = "alarm";
+    alarm["name"] = rule.name;
+    alarm["state"] = raise ? "raised" : "cleared";
+    alarm["severity"] = raise ? rule.severity : std::string("info");
+    alarm["message"] = msg.str();
+    alarm["time_ns"] = now_ns;
+    if (valid)
+      alarm["value"] = value;
+    alarms.push_back(std::move(alarm));
+  }
+}
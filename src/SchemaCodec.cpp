@@ -0,0 +1,124 @@
+/**
+ * @file SchemaCodec.cpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/SchemaCodec.hpp"
+
+#include "opmonlib/InfoManager.hpp"
+
+#include <utility>
+
+using namespace dunedaq::opmonlib;
+
+std::vector<nlohmann::json>
+SchemaEncoder::encode(const nlohmann::json& message)
+{
+  std::vector<nlohmann::json> messages;
+  if (!message.is_object() || !message.contains(InfoManager::s_parent_tag)) {
+    messages.push_back(message);
+    return messages;
+  }
+
+  // Steady state: same structure as last time, only the values are copied out
+  nlohmann::json data = nlohmann::json::array();
+  data.get_ref<nlohmann::json::array_t&>().reserve(m_num_fields);
+  if (m_skeleton.is_null() || !copy_values(m_skeleton, message, data)) {
+    data = nlohmann::json::array();
+    m_skeleton = nlohmann::json();
+    build_skeleton(message, m_skeleton, data);
+    m_num_fields = data.size();
+    ++m_id;
+    messages.push_back({ { s_schema_tag, { { "id", m_id }, { "skeleton", m_skeleton } } } });
+  }
+  messages.push_back({ { s_values_tag, { { "schema", m_id }, { "data", std::move(data) } } } });
+  return messages;
+}
+
+bool
+SchemaEncoder::copy_values(const nlohmann::json& skeleton, const nlohmann::json& j, nlohmann::json& data) const
+{
+  if (skeleton.is_object()) {
+    if (!j.is_object() || j.size() != skeleton.size())
+      return false;
+    // Both are sorted maps, so equal structures iterate in step
+    auto s = skeleton.begin();
+    for (auto it = j.begin(); it != j.end(); ++it, ++s)
+      if (it.key() != s.key() || !copy_values(*s, *it, data))
+        return false;
+    return true;
+  }
+  if (skeleton.is_array()) {
+    if (!j.is_array() || j.size() != skeleton.size())
+      return false;
+    for (size_t i = 0; i < j.size(); ++i)
+      if (!copy_values(skeleton[i], j[i], data))
+        return false;
+    return true;
+  }
+  if (j.is_object() || j.is_array())
+    return false;
+  data.get_ref<nlohmann::json::array_t&>().push_back(j);
+  return true;
+}
+
+void
+SchemaEncoder::build_skeleton(const nlohmann::json& j, nlohmann::json& skeleton, nlohmann::json& data) const
+{
+  if (j.is_object()) {
+    skeleton = nlohmann::json::object();
+    for (auto& [key, value] : j.items())
+      build_skeleton(value, skeleton[key], data);
+  } else if (j.is_array()) {
+    skeleton = nlohmann::json::array();
+    for (auto& value : j) {
+      skeleton.push_back(nlohmann::json());
+      build_skeleton(value, skeleton.back(), data);
+    }
+  } else {
+    skeleton = data.size();
+    data.push_back(j);
+  }
+}
+
+bool
+SchemaDecoder::decode(const nlohmann::json& message, nlohmann::json& snapshot)
+{
+  if (message.is_object() && message.contains(SchemaEncoder::s_schema_tag)) {
+    auto& schema = message[SchemaEncoder::s_schema_tag];
+    m_id = schema.at("id").get<uint64_t>(); // NOLINT(build/unsigned)
+    m_skeleton = schema.at("skeleton");
+    return false;
+  }
+  if (message.is_object() && message.contains(SchemaEncoder::s_values_tag)) {
+    auto& values = message[SchemaEncoder::s_values_tag];
+    // Values for a schema we have not seen, e.g. when joining a stream half way
+    if (m_skeleton.is_null() || values.at("schema").get<uint64_t>() != m_id) // NOLINT(build/unsigned)
+      return false;
+    fill(m_skeleton, values.at("data"), snapshot);
+    return true;
+  }
+  snapshot = message;
+  return true;
+}
+
+void
+SchemaDecoder::fill(const nlohmann::json& skeleton, const nlohmann::json& data, nlohmann::json& snapshot)
+{
+  if (skeleton.is_object()) {
+    snapshot = nlohmann::json::object();
+    for (auto& [key, value] : skeleton.items())
+      fill(value, data, snapshot[key]);
+  } else if (skeleton.is_array()) {
+    snapshot = nlohmann::json::array();
+    for (auto& value : skeleton) {
+      snapshot.push_back(nlohmann::json());
+      fill(value, data, snapshot.back());
+    }
+  } else {
+    snapshot = data.at(skeleton.get<size_t>());
+  }
+}
@@ -0,0 +1,456 @@
+/**
+ * @file TimeSeries.cpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/TimeSeries.hpp"
+
+#include "opmonlib/InfoCollector.hpp"
+#include "opmonlib/InfoManager.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+using namespace dunedaq::opmonlib;
+
+namespace {
+
+using Visitor = std::function<void(const std::string&, int64_t, const nlohmann::json&)>;
+
+uint64_t // NOLINT(build/unsigned)
+zigzag(int64_t v)
+{
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); // NOLINT(build/unsigned)
+}
+
+int64_t
+unzigzag(uint64_t v) // NOLINT(build/unsigned)
+{
+  return static_cast<int64_t>((v >> 1) ^ (~(v & 1) + 1));
+}
+
+// Wrapping arithmetic, so that e.g. INT64_MIN after INT64_MAX is well defined
+int64_t
+difference(int64_t a, int64_t b)
+{
+  return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b)); // NOLINT(build/unsigned)
+}
+
+int64_t
+sum(int64_t a, int64_t b)
+{
+  return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b)); // NOLINT(build/unsigned)
+}
+
+uint64_t // NOLINT(build/unsigned)
+double_bits(double d)
+{
+  uint64_t bits; // NOLINT(build/unsigned)
+  std::memcpy(&bits, &d, sizeof(bits));
+  return bits;
+}
+
+void
+visit_value(const nlohmann::json& value, const std::string& series, int64_t time, const Visitor& f)
+{
+  if (value.is_object()) {
+    for (auto& [key, member] : value.items())
+      visit_value(member, series.back() == '/' ? series + key : series + '.' + key, time, f);
+  } else if (value.is_array()) {
+    for (size_t i = 0; i < value.size(); ++i)
+      visit_value(value[i], series + '[' + std::to_string(i) + ']', time, f);
+  } else {
+    f(series, time, value);
+  }
+}
+
+void
+visit_node(const nlohmann::json& node, const std::string& path, const Visitor& f)
+{
+  if (!node.is_object())
+    return;
+  auto props = node.find(InfoCollector::s_prop_tag);
+  if (props != node.end()) {
+    for (auto& [info_type, block] : props->items()) {
+      auto data = block.find(InfoCollector::s_data_tag);
+      if (data == block.end())
+        continue;
+      visit_value(*data, path + '/' + info_type + '/', block.value(InfoCollector::s_time_tag, int64_t(0)), f);
+    }
+  }
+  auto children = node.find(InfoCollector::s_children_tag);
+  if (children != node.end())
+    for (auto& [name, child] : children->items())
+      visit_node(child, path + '.' + name, f);
+}
+
+// Reads the bits of one block; throws std::out_of_range past its end
+class BitReader
+{
+public:
+  BitReader(const uint8_t* data, size_t size) // NOLINT(build/unsigned)
+    : m_data(data)
+    , m_size(size)
+  {}
+
+  uint64_t read(unsigned n) // NOLINT(build/unsigned)
+  {
+    uint64_t v = 0; // NOLINT(build/unsigned)
+    while (n > 0) {
+      if (m_pos >= m_size)
+        throw std::out_of_range("time series block");
+      unsigned room = 8 - m_bit;
+      unsigned take = std::min(room, n);
+      uint64_t bits = (m_data[m_pos] >> (room - take)) & ((1U << take) - 1); // NOLINT(build/unsigned)
+      v = (v << take) | bits;
+      m_bit += take;
+      if (m_bit == 8) {
+        m_bit = 0;
+        ++m_pos;
+      }
+      n -= take;
+    }
+    return v;
+  }
+
+  uint64_t read_varint() // NOLINT(build/unsigned)
+  {
+    uint64_t v = 0; // NOLINT(build/unsigned)
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      auto byte = read(8);
+      v |= (byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0)
+        break;
+    }
+    return v;
+  }
+
+private:
+  const uint8_t* m_data; // NOLINT(build/unsigned)
+  size_t m_size;
+  size_t m_pos = 0;
+  unsigned m_bit = 0;
+};
+
+bool
+read_varint(std::istream& is, uint64_t& v) // NOLINT(build/unsigned)
+{
+  v = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    int byte = is.get();
+    if (byte == std::char_traits<char>::eof())
+      return false;
+    v |= static_cast<uint64_t>(byte & 0x7f) << shift; // NOLINT(build/unsigned)
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return true;
+}
+
+} // namespace
+
+void
+dunedaq::opmonlib::visit_series(const nlohmann::json& snapshot, const Visitor& f)
+{
+  auto root = snapshot.find(InfoManager::s_parent_tag);
+  if (root == snapshot.end())
+    return;
+  for (auto& [name, node] : root->items())
+    visit_node(node, name, f);
+}
+
+void
+TimeSeriesWriter::BitWriter::write(uint64_t bits, unsigned n) // NOLINT(build/unsigned)
+{
+  while (n > 0) {
+    if (m_bit == 0)
+      m_bytes.push_back(0);
+    unsigned room = 8 - m_bit;
+    unsigned take = std::min(room, n);
+    auto chunk = static_cast<uint8_t>((bits >> (n - take)) & ((1U << take) - 1)); // NOLINT(build/unsigned)
+    m_bytes.back() |= static_cast<uint8_t>(chunk << (room - take));              // NOLINT(build/unsigned)
+    m_bit = (m_bit + take) % 8;
+    n -= take;
+  }
+}
+
+void
+TimeSeriesWriter::BitWriter::write_varint(uint64_t value) // NOLINT(build/unsigned)
+{
+  while (value >= 0x80) {
+    write((value & 0x7f) | 0x80, 8);
+    value >>= 7;
+  }
+  write(value, 8);
+}
+
+TimeSeriesWriter::TimeSeriesWriter(std::ostream& os, size_t block_size, bool write_magic)
+  : m_os(os)
+  , m_block_size(std::max<size_t>(block_size, 1))
+{
+  if (write_magic) {
+    m_os.write(s_magic, 4);
+    m_bytes_written += 4;
+  }
+}
+
+TimeSeriesWriter::~TimeSeriesWriter()
+{
+  flush();
+}
+
+TimeSeriesWriter::Stream&
+TimeSeriesWriter::stream(const std::string& series, bool is_double)
+{
+  auto it = m_streams.find(series);
+  if (it != m_streams.end() && it->second.is_double == is_double)
+    return it->second;
+
+  // New series, or one changing kind: (re)define it under a new id
+  if (it != m_streams.end()) {
+    write_block(it->second);
+    m_streams.erase(it);
+  }
+  Stream& s = m_streams[series];
+  s.id = m_next_id++;
+  s.is_double = is_double;
+  m_os.put('S');
+  write_varint(s.id);
+  write_varint(series.size());
+  m_os.write(series.data(), static_cast<std::streamsize>(series.size()));
+  m_os.put(is_double ? 1 : 0);
+  m_bytes_written += 2 + series.size();
+  return s;
+}
+
+void
+TimeSeriesWriter::append_time(Stream& s, int64_t time)
+{
+  if (s.count == 0) {
+    s.bits.write_varint(zigzag(time));
+    s.time_delta = 0;
+    s.time = time;
+    return;
+  }
+
+  // Regular publishing makes most delta-of-deltas 0, i.e. a single bit
+  auto delta = difference(time, s.time);
+  auto dod = difference(delta, s.time_delta);
+  if (dod == 0) {
+    s.bits.write(0, 1);
+  } else if (dod >= -63 && dod <= 64) {
+    s.bits.write(0b10, 2);
+    s.bits.write(static_cast<uint64_t>(dod + 63), 7); // NOLINT(build/unsigned)
+  } else if (dod >= -255 && dod <= 256) {
+    s.bits.write(0b110, 3);
+    s.bits.write(static_cast<uint64_t>(dod + 255), 9); // NOLINT(build/unsigned)
+  } else if (dod >= -2047 && dod <= 2048) {
+    s.bits.write(0b1110, 4);
+    s.bits.write(static_cast<uint64_t>(dod + 2047), 12); // NOLINT(build/unsigned)
+  } else {
+    s.bits.write(0b1111, 4);
+    s.bits.write(static_cast<uint64_t>(dod), 64); // NOLINT(build/unsigned)
+  }
+  s.time_delta = delta;
+  s.time = time;
+}
+
+void
+TimeSeriesWriter::append(const std::string& series, int64_t time, int64_t value)
+{
+  Stream& s = stream(series, false);
+  append_time(s, time);
+  s.bits.write_varint(zigzag(difference(value, static_cast<int64_t>(s.value))));
+  s.value = static_cast<uint64_t>(value); // NOLINT(build/unsigned)
+  if (++s.count >= m_block_size)
+    write_block(s);
+}
+
+void
+TimeSeriesWriter::append(const std::string& series, int64_t time, double value)
+{
+  Stream& s = stream(series, true);
+  append_time(s, time);
+  append_bits(s, double_bits(value));
+  if (++s.count >= m_block_size)
+    write_block(s);
+}
+
+void
+TimeSeriesWriter::append_bits(Stream& s, uint64_t value) // NOLINT(build/unsigned)
+{
+  if (s.count == 0) {
+    s.bits.write(value, 64);
+    s.value = value;
+    s.leading = ~0U;
+    return;
+  }
+
+  // Unchanged values cost one bit; slowly changing ones only their differing middle bits
+  auto x = value ^ s.value;
+  s.value = value;
+  if (x == 0) {
+    s.bits.write(0, 1);
+    return;
+  }
+  unsigned leading = std::min(static_cast<unsigned>(__builtin_clzll(x)), 31U);
+  unsigned trailing = static_cast<unsigned>(__builtin_ctzll(x));
+  if (s.leading != ~0U && leading >= s.leading && trailing >= s.trailing) {
+    s.bits.write(0b10, 2);
+    s.bits.write(x >> s.trailing, 64 - s.leading - s.trailing);
+    return;
+  }
+  unsigned meaningful = 64 - leading - trailing;
+  s.bits.write(0b11, 2);
+  s.bits.write(leading, 5);
+  s.bits.write(meaningful & 63, 6);
+  s.bits.write(x >> trailing, meaningful);
+  s.leading = leading;
+  s.trailing = trailing;
+}
+
+void
+TimeSeriesWriter::append(const std::string& series, int64_t time, const nlohmann::json& value)
+{
+  if (value.is_number_float()) {
+    append(series, time, value.get<double>());
+  } else if (value.is_number_unsigned()) {
+    auto u = value.get<uint64_t>(); // NOLINT(build/unsigned)
+    if (u > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) // NOLINT(build/unsigned)
+      append(series, time, static_cast<double>(u));
+    else
+      append(series, time, static_cast<int64_t>(u));
+  } else if (value.is_number_integer()) {
+    append(series, time, value.get<int64_t>());
+  } else if (value.is_boolean()) {
+    append(series, time, static_cast<int64_t>(value.get<bool>()));
+  }
+}
+
+void
+TimeSeriesWriter::write_block(Stream& s)
+{
+  if (s.count == 0)
+    return;
+  auto& bytes = s.bits.bytes();
+  m_os.put('B');
+  write_varint(s.id);
+  write_varint(s.count);
+  write_varint(bytes.size());
+  m_os.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size())); // NOLINT
+  m_bytes_written += 1 + bytes.size();
+  s.bits.clear();
+  s.count = 0;
+  s.value = 0;
+}
+
+void
+TimeSeriesWriter::write_varint(uint64_t value) // NOLINT(build/unsigned)
+{
+  while (value >= 0x80) {
+    m_os.put(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+    ++m_bytes_written;
+  }
+  m_os.put(static_cast<char>(value));
+  ++m_bytes_written;
+}
+
+void
+TimeSeriesWriter::flush()
+{
+  for (auto& [name, s] : m_streams)
+    write_block(s);
+  m_os.flush();
+}
+
+bool
+TimeSeriesReader::read(std::istream& is, const Callback& f)
+{
+  char magic[4];
+  if (!is.read(magic, 4) || std::memcmp(magic, TimeSeriesWriter::s_magic, 4) != 0)
+    return false;
+
+  std::vector<uint8_t> bytes; // NOLINT(build/unsigned)
+  for (int tag = is.get(); tag != std::char_traits<char>::eof(); tag = is.get()) {
+    uint64_t id, length, count; // NOLINT(build/unsigned)
+    if (tag == 'S') {
+      Series series;
+      if (!read_varint(is, id) || !read_varint(is, length))
+        return false;
+      series.name.resize(length);
+      if (!is.read(series.name.data(), static_cast<std::streamsize>(length)))
+        return false;
+      int kind = is.get();
+      if (kind == std::char_traits<char>::eof())
+        return false;
+      series.is_double = kind == 1;
+      m_series[id] = std::move(series);
+      continue;
+    }
+    if (tag != 'B' || !read_varint(is, id) || !read_varint(is, count) || !read_varint(is, length))
+      return false;
+    bytes.resize(length);
+    if (!is.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(length))) // NOLINT
+      return false;
+    auto it = m_series.find(id);
+    if (it == m_series.end())
+      return false;
+
+    const Series& series = it->second;
+    BitReader bits(bytes.data(), bytes.size());
+    Sample sample{ 0, series.is_double, 0, 0. };
+    int64_t delta = 0;
+    uint64_t value = 0; // NOLINT(build/unsigned)
+    unsigned leading = 0, trailing = 0;
+    try {
+      for (uint64_t i = 0; i < count; ++i) { // NOLINT(build/unsigned)
+        // Timestamp
+        if (i == 0) {
+          sample.time = unzigzag(bits.read_varint());
+        } else {
+          int64_t dod = 0;
+          if (bits.read(1) == 0)
+            dod = 0;
+          else if (bits.read(1) == 0)
+            dod = static_cast<int64_t>(bits.read(7)) - 63;
+          else if (bits.read(1) == 0)
+            dod = static_cast<int64_t>(bits.read(9)) - 255;
+          else if (bits.read(1) == 0)
+            dod = static_cast<int64_t>(bits.read(12)) - 2047;
+          else
+            dod = static_cast<int64_t>(bits.read(64));
+          delta = sum(delta, dod);
+          sample.time = sum(sample.time, delta);
+        }
+
+        // Value
+        if (!series.is_double) {
+          sample.integer = sum(sample.integer, unzigzag(bits.read_varint()));
+        } else if (i == 0) {
+          value = bits.read(64);
+        } else if (bits.read(1) == 1) {
+          if (bits.read(1) == 1) {
+            leading = static_cast<unsigned>(bits.read(5));
+            unsigned meaningful = static_cast<unsigned>(bits.read(6));
+            meaningful = meaningful == 0 ? 64 : meaningful;
+            trailing = 64 - leading - meaningful;
+          }
+          value ^= bits.read(64 - leading - trailing) << trailing;
+        }
+        if (series.is_double)
+          std::memcpy(&sample.real, &value, sizeof(value));
+        f(series.name, sample);
+      }
+    } catch (const std::out_of_range&) {
+      return false;
+    }
+  }
+  return true;
+}
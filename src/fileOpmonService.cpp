@@ -0,0 +1,135 @@
+/**
+ * @file fileOpmonService.cpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/OpmonService.hpp"
+#include "opmonlib/SchemaCodec.hpp"
+#include "opmonlib/Tracing.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace dunedaq {
+
+ERS_DECLARE_ISSUE(opmonlib, BadFile, "Can not open file to store opmon data: " << filename, ((std::string)filename))
+
+} // namespace dunedaq
+
+OPMONLIB_PROBE_SEMAPHORE_DECLARATION(serialize_begin);
+OPMONLIB_PROBE_SEMAPHORE_DECLARATION(serialize_end);
+
+namespace dunedaq::opmonlib {
+
+class fileOpmonService : public OpmonService
+{
+public:
+  explicit fileOpmonService(std::string uri)
+    : OpmonService(uri)
+  {
+    auto col = uri.find_last_of(':');
+    auto sep = uri.find("://");
+    std::string fname;
+    if (col == std::string::npos || sep == std::string::npos) { // assume filename
+      fname = uri;
+    } else {
+      fname = uri.substr(sep + 3);
+    }
+
+    // ?encoding=schema writes the structure once and then only the values of each snapshot;
+    // ?flush=N flushes the file every N publications
+    auto query = fname.find('?');
+    if (query != std::string::npos) {
+      std::istringstream is(fname.substr(query + 1));
+      std::string param;
+      while (std::getline(is, param, '&')) {
+        if (param == "encoding=schema")
+          m_encoder = std::make_unique<SchemaEncoder>();
+        else if (param.rfind("flush=", 0) == 0) {
+          auto value = param.substr(6);
+          if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != std::string::npos ||
+              std::stoul(value) == 0)
+            throw OpmonServiceCreationFailed(ERS_HERE, uri + ": flush must be a number of publications >= 1");
+          m_flush_every = std::stoul(value);
+        }
+      }
+      fname.erase(query);
+    }
+
+    m_ofs.open(fname, std::ios::out | std::ios::app);
+    if (!m_ofs.is_open()) {
+      ers::error(BadFile(ERS_HERE, fname));
+    }
+  }
+
+  void publish(nlohmann::json j)
+  {
+    if (m_ofs.is_open()) {
+      int64_t t0 = OPMONLIB_PROBE_ENABLED(serialize_end) ? tracing::now_ns() : 0;
+      OPMONLIB_PROBE1(serialize_begin, get_uri().c_str());
+      size_t bytes = 0;
+      if (m_encoder) {
+        for (auto& message : m_encoder->encode(j)) {
+          auto text = message.dump();
+          bytes += text.size() + 1;
+          m_ofs << text << '\n';
+        }
+      } else {
+        auto text = j.dump();
+        bytes = text.size() + 1;
+        m_ofs << text << '\n';
+      }
+      if (OPMONLIB_PROBE_ENABLED(serialize_end))
+        OPMONLIB_PROBE3(serialize_end, get_uri().c_str(), bytes, tracing::now_ns() - t0);
+      count_flush();
+    } else {
+      TLOG() << "Opmon file is not open";
+    }
+  }
+
+  // The schema encoding is stateful, so those files are not given shared text
+  std::string get_format() const { return m_encoder ? std::string() : "json"; }
+
+  void publish_serialized(const std::string& text)
+  {
+    if (m_ofs.is_open()) {
+      m_ofs << text << '\n';
+      count_flush();
+    } else {
+      TLOG() << "Opmon file is not open";
+    }
+  }
+
+protected:
+  typedef OpmonService inherited;
+
+private:
+  void count_flush()
+  {
+    if (++m_unflushed >= m_flush_every) {
+      m_ofs.flush();
+      m_unflushed = 0;
+    }
+  }
+
+  std::ofstream m_ofs;
+  std::unique_ptr<SchemaEncoder> m_encoder;
+  size_t m_flush_every = 1;
+  size_t m_unflushed = 0;
+};
+
+// Registered as a built-in service in OpmonService.cpp
+std::shared_ptr<OpmonService>
+make_file_service(const std::string& uri)
+{
+  return std::shared_ptr<OpmonService>(new fileOpmonService(uri));
+}
+
+} // namespace dunedaq::opmonlib
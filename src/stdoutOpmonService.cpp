@@ -0,0 +1,77 @@
+/**
+ * @file stdoutOpmonService.cpp
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/OpmonService.hpp"
+#include "opmonlib/Tracing.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <iostream>
+#include <memory>
+#include <string>
+
+OPMONLIB_PROBE_SEMAPHORE_DECLARATION(serialize_begin);
+OPMONLIB_PROBE_SEMAPHORE_DECLARATION(serialize_end);
+
+namespace dunedaq::opmonlib {
+
+class stdoutOpmonService : public OpmonService
+{
+public:
+  explicit stdoutOpmonService(std::string uri)
+    : OpmonService(uri)
+  {
+    auto sep = uri.find("://");
+    m_style = "flat";
+    if (sep != std::string::npos) { // assume filename
+      m_style = uri.substr(sep + 3);
+    }
+  }
+
+  void publish(nlohmann::json j)
+  {
+    int64_t t0 = OPMONLIB_PROBE_ENABLED(serialize_end) ? tracing::now_ns() : 0;
+    OPMONLIB_PROBE1(serialize_begin, get_uri().c_str());
+    std::string text;
+    serialize_snapshot(get_format(), j, text);
+    if (OPMONLIB_PROBE_ENABLED(serialize_end))
+      OPMONLIB_PROBE3(serialize_end, get_uri().c_str(), text.size(), tracing::now_ns() - t0);
+    publish_serialized(text);
+  }
+
+  std::string get_format() const
+  {
+    if (m_style == "flat")
+      return "json-flat";
+    return m_style == "formatted" ? "json-indented" : "json";
+  }
+
+  void publish_serialized(const std::string& text)
+  {
+    if (m_style == "flat") {
+      std::cout << text << '\n'; // NOLINT(runtime/output_format)
+    } else {
+      std::cout << text << std::endl; // NOLINT(runtime/output_format)
+    }
+  }
+
+protected:
+  typedef OpmonService inherited;
+
+private:
+  std::string m_style;
+};
+
+// Registered as a built-in service in OpmonService.cpp
+std::shared_ptr<OpmonService>
+make_stdout_service(const std::string& uri)
+{
+  return std::shared_ptr<OpmonService>(new stdoutOpmonService(uri));
+}
+
+} // namespace dunedaq::opmonlib
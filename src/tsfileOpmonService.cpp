@@ -0,0 +1,125 @@
+/**
+ * @file tsfileOpmonService.cpp
+ *
+ * Writes the numeric values of every snapshot to a file in the compact
+ * time series format of TimeSeries.hpp, one stream per series.
+ * URI: tsfile:///file/path/file_name.opts[?block=N&age=S]
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/OpmonService.hpp"
+#include "opmonlib/TimeSeries.hpp"
+#include "opmonlib/Tracing.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace dunedaq {
+
+ERS_DECLARE_ISSUE(opmonlib,
+                  BadTimeSeriesFile,
+                  "Can not open file to store opmon time series: " << filename,
+                  ((std::string)filename))
+
+} // namespace dunedaq
+
+OPMONLIB_PROBE_SEMAPHORE_DECLARATION(serialize_begin);
+OPMONLIB_PROBE_SEMAPHORE_DECLARATION(serialize_end);
+
+namespace dunedaq::opmonlib {
+
+class tsfileOpmonService : public OpmonService
+{
+public:
+  explicit tsfileOpmonService(std::string uri)
+    : OpmonService(uri)
+  {
+    auto sep = uri.find("://");
+    std::string fname = sep == std::string::npos ? uri : uri.substr(sep + 3);
+
+    // Samples per block: bigger blocks compress better, smaller ones reach the disk sooner;
+    // partial blocks are written anyway once `age` seconds have passed since the last write
+    size_t block_size = 60;
+    auto query = fname.find('?');
+    if (query != std::string::npos) {
+      std::istringstream is(fname.substr(query + 1));
+      std::string param;
+      while (std::getline(is, param, '&')) {
+        if (param.rfind("block=", 0) == 0)
+          block_size = parse_count(uri, param, 1);
+        else if (param.rfind("age=", 0) == 0)
+          m_max_age = std::chrono::seconds(parse_count(uri, param, 0));
+      }
+      fname.erase(query);
+    }
+
+    bool empty = std::ifstream(fname, std::ios::binary | std::ios::ate).tellg() <= 0;
+    m_ofs.open(fname, std::ios::out | std::ios::app | std::ios::binary);
+    if (!m_ofs.is_open()) {
+      ers::error(BadTimeSeriesFile(ERS_HERE, fname));
+      return;
+    }
+    m_writer = std::make_unique<TimeSeriesWriter>(m_ofs, block_size, empty);
+    m_last_flush = std::chrono::steady_clock::now();
+  }
+
+  void publish(nlohmann::json j)
+  {
+    if (!m_writer) {
+      TLOG() << "Opmon time series file is not open";
+      return;
+    }
+    int64_t t0 = OPMONLIB_PROBE_ENABLED(serialize_end) ? tracing::now_ns() : 0;
+    auto bytes0 = m_writer->get_bytes_written();
+    OPMONLIB_PROBE1(serialize_begin, get_uri().c_str());
+    visit_series(j, [this](const std::string& series, int64_t time, const nlohmann::json& value) {
+      m_writer->append(series, time, value);
+    });
+    auto now = std::chrono::steady_clock::now();
+    if (m_max_age.count() > 0 && now - m_last_flush >= m_max_age) {
+      m_writer->flush();
+      m_last_flush = now;
+    }
+    if (OPMONLIB_PROBE_ENABLED(serialize_end))
+      OPMONLIB_PROBE3(serialize_end, get_uri().c_str(), m_writer->get_bytes_written() - bytes0, tracing::now_ns() - t0);
+  }
+
+  // Events are not time series
+  void publish_event(nlohmann::json /*j*/) {}
+
+protected:
+  typedef OpmonService inherited;
+
+private:
+  // Value of a `name=N` query parameter, at least `min`
+  static size_t parse_count(const std::string& uri, const std::string& param, size_t min)
+  {
+    auto value = param.substr(param.find('=') + 1);
+    if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != std::string::npos ||
+        std::stoul(value) < min)
+      throw OpmonServiceCreationFailed(ERS_HERE, uri + ": " + param + " is not a number >= " + std::to_string(min));
+    return std::stoul(value);
+  }
+
+  std::ofstream m_ofs;
+  std::unique_ptr<TimeSeriesWriter> m_writer;
+  std::chrono::seconds m_max_age{ 300 };
+  std::chrono::steady_clock::time_point m_last_flush;
+};
+
+// Registered as a built-in service in OpmonService.cpp
+std::shared_ptr<OpmonService>
+make_tsfile_service(const std::string& uri)
+{
+  return std::shared_ptr<OpmonService>(new tsfileOpmonService(uri));
+}
+
+} // namespace dunedaq::opmonlib
@@ -0,0 +1,325 @@
+/**
+ * @file opmonlib_bench.cpp
+ *
+ * End-to-end benchmark: a synthetic tree of modules x links x fields, whose
+ * counters are incremented by hot-path updater threads, is published with
+ * InfoManager::publish_info() to each of the given services in turn.
+ * Reports latency percentiles of the gather, serialize and publish phases (as
+ * split by InfoManager::get_phase_counts()), allocations and bytes written per
+ * publication, the CPU used by the monitoring thread and the slowdown of the
+ * updater threads.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/AccountingHooks.hpp"
+#include "opmonlib/InfoCollector.hpp"
+#include "opmonlib/InfoManager.hpp"
+#include "opmonlib/InfoProvider.hpp"
+#include "opmonlib/OpmonService.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <getopt.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq::opmonlib;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using AtomicCounter = std::atomic<uint64_t>; // NOLINT(build/unsigned)
+
+// Stands in for a generated info structure with a run-time number of fields
+struct LinkInfo
+{
+  inline static const std::string info_type = "opmonlib_bench.LinkInfo";
+  const AtomicCounter* counters;
+  const std::vector<std::string>* field_names;
+};
+
+void
+to_json(nlohmann::json& j, const LinkInfo& info)
+{
+  for (size_t f = 0; f < info.field_names->size(); ++f)
+    j[(*info.field_names)[f]] = info.counters[f].load(std::memory_order_relaxed);
+}
+
+class Link : public InfoProvider
+{
+public:
+  Link(const AtomicCounter* counters, const std::vector<std::string>* field_names)
+    : m_info{ counters, field_names }
+  {}
+
+  void gather_stats(InfoCollector& ic, int /*level*/) override { ic.add(m_info); }
+
+private:
+  LinkInfo m_info;
+};
+
+class Module : public InfoProvider
+{
+public:
+  void gather_stats(InfoCollector& ic, int level) override
+  {
+    for (size_t l = 0; l < links.size(); ++l)
+      ic.add("link" + std::to_string(l), links[l], level);
+  }
+
+  std::vector<Link> links;
+};
+
+class Partition : public InfoProvider
+{
+public:
+  void gather_stats(InfoCollector& ic, int level) override
+  {
+    for (size_t m = 0; m < modules.size(); ++m)
+      ic.add("module" + std::to_string(m), modules[m], level);
+  }
+
+  std::vector<Module> modules;
+};
+
+// Thread CPU time, in seconds
+double
+thread_cpu_time()
+{
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+}
+
+double
+percentile(std::vector<double>& v, double p)
+{
+  if (v.empty())
+    return 0.;
+  auto n = static_cast<size_t>(p * static_cast<double>(v.size() - 1));
+  std::nth_element(v.begin(), v.begin() + n, v.end());
+  return v[n];
+}
+
+void
+print_phase(const std::string& name, std::vector<double>& us)
+{
+  std::cout << "  " << std::left << std::setw(10) << name << std::right << " us: p50 " << std::setw(9)
+            << percentile(us, 0.5) << "  p90 " << std::setw(9) << percentile(us, 0.9) << "  p99 " << std::setw(9)
+            << percentile(us, 0.99) << "  max " << std::setw(9) << percentile(us, 1.) << "\n";
+}
+
+// Hot-path updaters: each increments random counters until told to stop
+class Updaters
+{
+public:
+  Updaters(std::vector<AtomicCounter>& counters, unsigned num_threads)
+    : m_counts(num_threads)
+  {
+    for (unsigned t = 0; t < num_threads; ++t) {
+      m_threads.emplace_back([this, &counters, t] {
+        uint64_t x = 0x9e3779b97f4a7c15ULL * (t + 1); // NOLINT(build/unsigned)
+        uint64_t n = 0;                                // NOLINT(build/unsigned)
+        while (!m_stop.load(std::memory_order_relaxed)) {
+          for (int i = 0; i < 256; ++i) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            counters[x % counters.size()].fetch_add(1, std::memory_order_relaxed);
+          }
+          n += 256;
+          m_counts[t].store(n, std::memory_order_relaxed);
+        }
+      });
+    }
+  }
+
+  ~Updaters()
+  {
+    m_stop = true;
+    for (auto& t : m_threads)
+      t.join();
+  }
+
+  uint64_t count() const // NOLINT(build/unsigned)
+  {
+    uint64_t sum = 0; // NOLINT(build/unsigned)
+    for (auto& c : m_counts)
+      sum += c.load(std::memory_order_relaxed);
+    return sum;
+  }
+
+private:
+  std::atomic<bool> m_stop{ false };
+  std::vector<AtomicCounter> m_counts;
+  std::vector<std::thread> m_threads;
+};
+
+// Updates per second over `duration`, with or without monitoring running in parallel
+double
+update_rate(const Updaters& updaters, std::chrono::duration<double> duration)
+{
+  auto n0 = updaters.count();
+  auto t0 = Clock::now();
+  std::this_thread::sleep_for(duration);
+  return static_cast<double>(updaters.count() - n0) / std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+void
+usage(const char* name)
+{
+  std::cerr << "Usage: " << name << " [options] [URI...]\n"
+            << "  -m, --modules N    number of modules (default 10)\n"
+            << "  -k, --links N      links per module (default 10)\n"
+            << "  -f, --fields N     counters per link (default 20)\n"
+            << "  -t, --threads N    hot-path updater threads (default 2)\n"
+            << "  -i, --interval MS  time between publications (default 100, 0 for back to back)\n"
+            << "  -d, --duration S   seconds to run against each service (default 5)\n"
+            << "  -L, --level N      gather level (default 0)\n"
+            << "  -h, --help         show this message\n"
+            << "URIs are as given to InfoManager; the default is file:///tmp/opmonlib_bench.json\n";
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  unsigned modules = 10, links = 10, fields = 20, threads = 2;
+  int interval_ms = 100, level = 0;
+  double duration = 5.;
+
+  static const option long_options[] = {
+    { "modules", required_argument, nullptr, 'm' }, { "links", required_argument, nullptr, 'k' },
+    { "fields", required_argument, nullptr, 'f' },  { "threads", required_argument, nullptr, 't' },
+    { "interval", required_argument, nullptr, 'i' }, { "duration", required_argument, nullptr, 'd' },
+    { "level", required_argument, nullptr, 'L' },   { "help", no_argument, nullptr, 'h' },
+    { nullptr, 0, nullptr, 0 }
+  };
+  int c;
+  while ((c = getopt_long(argc, argv, "m:k:f:t:i:d:L:h", long_options, nullptr)) != -1) {
+    switch (c) {
+      case 'm':
+        modules = std::stoul(optarg);
+        break;
+      case 'k':
+        links = std::stoul(optarg);
+        break;
+      case 'f':
+        fields = std::stoul(optarg);
+        break;
+      case 't':
+        threads = std::stoul(optarg);
+        break;
+      case 'i':
+        interval_ms = std::stoi(optarg);
+        break;
+      case 'd':
+        duration = std::stod(optarg);
+        break;
+      case 'L':
+        level = std::stoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return c == 'h' ? 0 : 1;
+    }
+  }
+  std::vector<std::string> uris(argv + optind, argv + argc);
+  if (uris.empty())
+    uris.push_back("file:///tmp/opmonlib_bench.json");
+  if (modules == 0 || links == 0 || fields == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // Synthetic tree over one flat array of counters
+  std::vector<AtomicCounter> counters(size_t(modules) * links * fields);
+  std::vector<std::string> field_names;
+  for (unsigned f = 0; f < fields; ++f)
+    field_names.push_back("counter_" + std::to_string(f));
+  Partition partition;
+  partition.modules.resize(modules);
+  for (unsigned m = 0; m < modules; ++m)
+    for (unsigned l = 0; l < links; ++l)
+      partition.modules[m].links.emplace_back(&counters[(size_t(m) * links + l) * fields], &field_names);
+
+  std::cout << modules << " modules x " << links << " links x " << fields << " fields = " << counters.size()
+            << " values, " << threads << " updater threads, level " << level << ", interval " << interval_ms
+            << " ms\n";
+
+  Updaters updaters(counters, threads);
+  std::cout << std::fixed << std::setprecision(1);
+
+  for (auto& uri : uris) {
+    std::unique_ptr<InfoManager> manager;
+    try {
+      manager = std::make_unique<InfoManager>(uri);
+    } catch (const OpmonServiceCreationFailed& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    manager->set_provider(partition);
+
+    double idle_rate = threads > 0 ? update_rate(updaters, std::chrono::seconds(1)) : 0.;
+
+    std::vector<double> gather_us, serialize_us, publish_us, cycle_us;
+    accounting::Counts counts;
+    double busy_rate = 0.;
+    std::thread rate_thread([&] {
+      if (threads > 0)
+        busy_rate = update_rate(updaters, std::chrono::duration<double>(duration));
+    });
+
+    auto cpu0 = thread_cpu_time();
+    auto start = Clock::now();
+    auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(duration));
+    auto next = start;
+    while (Clock::now() < end) {
+      auto t0 = Clock::now();
+      manager->publish_info(level);
+      auto t1 = Clock::now();
+
+      auto phases = manager->get_phase_counts();
+      gather_us.push_back(std::chrono::duration<double, std::micro>(phases.gather_time).count());
+      serialize_us.push_back(std::chrono::duration<double, std::micro>(phases.serialize_time).count());
+      publish_us.push_back(
+        std::chrono::duration<double, std::micro>(phases.publish_time - phases.serialize_time).count());
+      cycle_us.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+      counts += phases.gather;
+      counts += phases.publish;
+      next += std::chrono::milliseconds(interval_ms);
+      std::this_thread::sleep_until(next);
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    double cpu = thread_cpu_time() - cpu0;
+    rate_thread.join();
+
+    std::cout << uri << ": " << cycle_us.size() << " cycles in " << elapsed << " s\n";
+    print_phase("gather", gather_us);
+    print_phase("serialize", serialize_us);
+    print_phase("publish", publish_us);
+    print_phase("total", cycle_us);
+    auto cycles = static_cast<double>(std::max<size_t>(cycle_us.size(), 1));
+    std::cout << "  " << counts.allocations / cycles << " allocations and " << counts.writes / cycles
+              << " writes per publication, " << counts.written_bytes / elapsed / 1e6
+              << " MB/s written, monitoring thread CPU " << 100. * cpu / elapsed << "% of a core\n";
+    if (threads > 0)
+      std::cout << "  updaters: " << idle_rate / 1e6 << " M updates/s idle, " << busy_rate / 1e6
+                << " M updates/s while monitoring (" << 100. * (1. - busy_rate / idle_rate) << "% slower)\n";
+  }
+  return 0;
+}
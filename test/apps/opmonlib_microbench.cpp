@@ -0,0 +1,309 @@
+/**
+ * @file opmonlib_microbench.cpp
+ *
+ * Microbenchmarks of the monitoring hot spots: InfoCollector::add, nested
+ * collectors, InfoManager::gather_info, serialization and the file service
+ * under different flush policies.
+ *
+ * Each benchmark is calibrated to run for at least --min-time, repeated
+ * --repetitions times, and reported as the median and minimum time per
+ * operation. Baseline results are kept in docs/Microbenchmark-baseline.md.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "opmonlib/InfoCollector.hpp"
+#include "opmonlib/InfoManager.hpp"
+#include "opmonlib/InfoProvider.hpp"
+#include "opmonlib/OpmonService.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace dunedaq::opmonlib;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Keep the compiler from optimising away a result
+template<typename T>
+void
+do_not_optimize(const T& value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Options
+{
+  double min_time = 0.2;
+  int repetitions = 5;
+  std::string filter;
+};
+
+class Harness
+{
+public:
+  explicit Harness(const Options& options)
+    : m_options(options)
+  {
+    std::cout << std::left << std::setw(36) << "benchmark" << std::right << std::setw(14) << "median ns/op"
+              << std::setw(14) << "min ns/op" << std::setw(14) << "iterations" << "\n";
+  }
+
+  // `body(n)` runs the operation n times
+  void run(const std::string& name, const std::function<void(size_t)>& body)
+  {
+    if (name.find(m_options.filter) == std::string::npos)
+      return;
+
+    // Grow the iteration count until one run takes a tenth of the minimum time
+    size_t n = 1;
+    double seconds = 0.;
+    for (;;) {
+      seconds = time(body, n);
+      if (seconds >= m_options.min_time / 10 || n >= (size_t(1) << 30))
+        break;
+      n *= seconds > 0 ? std::clamp<size_t>(static_cast<size_t>(m_options.min_time / 10 / seconds), 2, 100) : 100;
+    }
+    n = std::max<size_t>(1, static_cast<size_t>(static_cast<double>(n) * m_options.min_time / seconds));
+
+    std::vector<double> ns_per_op;
+    for (int r = 0; r < m_options.repetitions; ++r)
+      ns_per_op.push_back(time(body, n) * 1e9 / static_cast<double>(n));
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+    std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(14) << ns_per_op[ns_per_op.size() / 2] << std::setw(14) << ns_per_op.front()
+              << std::setw(14) << n << std::endl;
+  }
+
+private:
+  static double time(const std::function<void(size_t)>& body, size_t n)
+  {
+    auto t0 = Clock::now();
+    body(n);
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+  }
+
+  const Options& m_options;
+};
+
+// Stand-ins for generated info structures
+struct SmallInfo
+{
+  inline static const std::string info_type = "opmonlib_microbench.SmallInfo";
+  uint64_t sent = 1;     // NOLINT(build/unsigned)
+  uint64_t received = 2; // NOLINT(build/unsigned)
+  double rate = 3.5;
+};
+
+void
+to_json(nlohmann::json& j, const SmallInfo& info)
+{
+  j = nlohmann::json{ { "sent", info.sent }, { "received", info.received }, { "rate", info.rate } };
+}
+
+struct LargeInfo
+{
+  inline static const std::string info_type = "opmonlib_microbench.LargeInfo";
+  static constexpr size_t s_num_fields = 64;
+  std::array<double, s_num_fields> values{};
+};
+
+const std::vector<std::string>&
+large_field_names()
+{
+  static const std::vector<std::string> names = [] {
+    std::vector<std::string> n;
+    for (size_t f = 0; f < LargeInfo::s_num_fields; ++f)
+      n.push_back("field_" + std::to_string(f));
+    return n;
+  }();
+  return names;
+}
+
+void
+to_json(nlohmann::json& j, const LargeInfo& info)
+{
+  auto& names = large_field_names();
+  for (size_t f = 0; f < LargeInfo::s_num_fields; ++f)
+    j[names[f]] = info.values[f];
+}
+
+class Leaf : public InfoProvider
+{
+public:
+  void gather_stats(InfoCollector& ic, int /*level*/) override { ic.add(m_info); }
+
+private:
+  SmallInfo m_info;
+};
+
+class Node : public InfoProvider
+{
+public:
+  void gather_stats(InfoCollector& ic, int level) override
+  {
+    for (size_t c = 0; c < children.size(); ++c)
+      ic.add(names[c], *children[c], level);
+  }
+
+  std::vector<std::string> names;
+  std::vector<std::unique_ptr<InfoProvider>> children;
+};
+
+// A tree of `modules` x `links` leaves
+std::unique_ptr<Node>
+make_tree(size_t modules, size_t links)
+{
+  auto root = std::make_unique<Node>();
+  for (size_t m = 0; m < modules; ++m) {
+    auto module = std::make_unique<Node>();
+    for (size_t l = 0; l < links; ++l) {
+      module->names.push_back("link" + std::to_string(l));
+      module->children.push_back(std::make_unique<Leaf>());
+    }
+    root->names.push_back("module" + std::to_string(m));
+    root->children.push_back(std::move(module));
+  }
+  return root;
+}
+
+void
+usage(const char* name)
+{
+  std::cerr << "Usage: " << name << " [options]\n"
+            << "  -f, --filter TEXT       only run benchmarks whose name contains TEXT\n"
+            << "  -t, --min-time S        minimum time per repetition (default 0.2)\n"
+            << "  -r, --repetitions N     repetitions per benchmark (default 5)\n"
+            << "  -d, --directory DIR     directory for the file service benchmarks (default /tmp)\n"
+            << "  -h, --help              show this message\n";
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  Options options;
+  std::string directory = "/tmp";
+
+  static const option long_options[] = { { "filter", required_argument, nullptr, 'f' },
+                                         { "min-time", required_argument, nullptr, 't' },
+                                         { "repetitions", required_argument, nullptr, 'r' },
+                                         { "directory", required_argument, nullptr, 'd' },
+                                         { "help", no_argument, nullptr, 'h' },
+                                         { nullptr, 0, nullptr, 0 } };
+  int c;
+  while ((c = getopt_long(argc, argv, "f:t:r:d:h", long_options, nullptr)) != -1) {
+    switch (c) {
+      case 'f':
+        options.filter = optarg;
+        break;
+      case 't':
+        options.min_time = std::stod(optarg);
+        break;
+      case 'r':
+        options.repetitions = std::max(1, std::stoi(optarg));
+        break;
+      case 'd':
+        directory = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return c == 'h' ? 0 : 1;
+    }
+  }
+
+  Harness harness(options);
+
+  harness.run("InfoCollector::add/small", [](size_t n) {
+    SmallInfo info;
+    for (size_t i = 0; i < n; ++i) {
+      InfoCollector ic;
+      ic.add(info);
+      do_not_optimize(ic.get_collected_infos());
+    }
+  });
+
+  harness.run("InfoCollector::add/large", [](size_t n) {
+    LargeInfo info;
+    for (size_t i = 0; i < n; ++i) {
+      InfoCollector ic;
+      ic.add(info);
+      do_not_optimize(ic.get_collected_infos());
+    }
+  });
+
+  harness.run("InfoCollector::add/nested", [](size_t n) {
+    SmallInfo info;
+    for (size_t i = 0; i < n; ++i) {
+      InfoCollector parent, child;
+      child.add(info);
+      parent.add("child", child);
+      do_not_optimize(parent.get_collected_infos());
+    }
+  });
+
+  // gather_info needs a manager; its own service is never published to
+  InfoManager manager("stdout://compact");
+  auto tree = make_tree(10, 10);
+  manager.set_provider(*tree);
+  harness.run("InfoManager::gather_info/10x10", [&](size_t n) {
+    for (size_t i = 0; i < n; ++i)
+      do_not_optimize(manager.gather_info(0));
+  });
+
+  auto snapshot = manager.gather_info(0);
+  harness.run("serialize/dump/10x10", [&](size_t n) {
+    for (size_t i = 0; i < n; ++i)
+      do_not_optimize(snapshot.dump());
+  });
+  harness.run("serialize/flatten/10x10", [&](size_t n) {
+    for (size_t i = 0; i < n; ++i)
+      do_not_optimize(snapshot.flatten());
+  });
+  // What stdout://flat prints
+  harness.run("serialize/flatten+dump(4)/10x10", [&](size_t n) {
+    for (size_t i = 0; i < n; ++i)
+      do_not_optimize(snapshot.flatten().dump(4));
+  });
+
+  // One module's worth of data per publication, to keep the files small
+  auto small_tree = make_tree(1, 10);
+  manager.set_provider(*small_tree);
+  auto small_snapshot = manager.gather_info(0);
+  for (auto flush : { "1", "100", "1000000" }) {
+    auto file = directory + "/opmonlib_microbench_" + flush + ".json";
+    std::remove(file.c_str());
+    std::shared_ptr<OpmonService> service;
+    try {
+      service = makeOpmonService("file://" + file + "?flush=" + flush);
+    } catch (const OpmonServiceCreationFailed& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    harness.run(std::string("fileOpmonService::publish/flush=") + flush, [&](size_t n) {
+      for (size_t i = 0; i < n; ++i)
+        service->publish(small_snapshot);
+    });
+    service.reset();
+    std::remove(file.c_str());
+  }
+  return 0;
+}
@@ -1,54 +1,256 @@
 /**
  * @file opmonlib_test.cpp
  *
+ * Regression checks on the cost of the monitoring hot paths: the calls made
+ * by instrumented code must not allocate once warmed up, and the file
+ * service must not issue more write syscalls than its flush policy allows.
+ * A few checks on values computed by the same building blocks follow.
+ * Exits with a non-zero status if any check fails.
+ *
  * This is part of the DUNE DAQ Application Framework, copyright 2020.
  * Licensing/copyright details are in the COPYING file that you should have
  * received with this code.
  */
 
-#include "opmonlib/MetricMonitor.hpp"
-#include "opmonlib/MetricRegistry.hpp"
+#include "opmonlib/AccountingHooks.hpp"
+
+#include "opmonlib/InfoManager.hpp"
+#include "opmonlib/InfoProvider.hpp"
+#include "opmonlib/LabeledFamily.hpp"
+#include "opmonlib/LatencyProbe.hpp"
+#include "opmonlib/Metrics.hpp"
+#include "opmonlib/OpmonService.hpp"
+#include "opmonlib/TimeSeries.hpp"
+
+#include <unistd.h>
 
-#include <atomic>
-#include <chrono>
-#include <future>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
-#include <map>
+#include <limits>
 #include <string>
-#include <thread>
+#include <vector>
 
 using namespace dunedaq::opmonlib;
 
+namespace {
+
+int s_failures = 0;
+
+void
+check(bool ok, const std::string& what, uint64_t value) // NOLINT(build/unsigned)
+{
+  std::cout << (ok ? "PASS " : "FAIL ") << what << " (" << value << ")" << std::endl;
+  if (!ok)
+    ++s_failures;
+}
+
+// Allocations made by the calling thread while running f
+template<typename F>
+uint64_t // NOLINT(build/unsigned)
+allocations_in(F&& f)
+{
+  auto before = accounting::thread_counts();
+  f();
+  return (accounting::thread_counts() - before).allocations;
+}
+
+struct SmallInfo
+{
+  inline static const std::string info_type = "opmonlib_test.SmallInfo";
+  uint64_t sent = 0; // NOLINT(build/unsigned)
+};
+
+void
+to_json(nlohmann::json& j, const SmallInfo& info)
+{
+  j = nlohmann::json{ { "sent", info.sent } };
+}
+
+struct LinkInfo
+{
+  inline static const std::string info_type = "opmonlib_test.LinkInfo";
+  uint64_t packets = 0; // NOLINT(build/unsigned)
+  bool up = false;
+  std::string name;
+};
+
+void
+to_json(nlohmann::json& j, const LinkInfo& info)
+{
+  j = nlohmann::json{ { "packets", info.packets }, { "up", info.up }, { "name", info.name } };
+}
+
+class Leaf : public InfoProvider
+{
+public:
+  void gather_stats(InfoCollector& ic, int /*level*/) override { ic.add(info); }
+  SmallInfo info;
+};
+
+class Root : public InfoProvider
+{
+public:
+  void gather_stats(InfoCollector& ic, int level) override
+  {
+    for (size_t i = 0; i < leaves.size(); ++i)
+      ic.add("leaf" + std::to_string(i), leaves[i], level);
+  }
+  std::vector<Leaf> leaves = std::vector<Leaf>(4);
+};
+
+} // namespace
+
 int
 main(int /*argc*/, char** /*argv*/)
 {
-  std::atomic<float> myMetric(0.1);
-  std::atomic<int> myMetric_int(5);
-  std::atomic<double> myMetric_double(500);
-  std::atomic<size_t> myMetric_sizet(40960);
-
-  MetricMonitor mmonitor(1, 1, "HostName", "AppName");
-
-  std::map<std::string, std::string> parameters;
-  parameters.insert({ "fileName", "metric_output.json" });
-  mmonitor.setupPublisher("file", parameters);
-
-  MetricRegistry mregistry = MetricRegistry::getInstance();
-  mregistry.registerMetric<std::atomic<float>>("Temperature", std::ref(myMetric));
-  mregistry.getValueOfMetric<std::atomic<float>>("Temperature");
-  mregistry.registerMetric<std::atomic<int>>("Humidity", std::ref(myMetric_int));
-  mregistry.getValueOfMetric<std::atomic<int>>("Humidity");
-
-  // 5 seconds later, I'll modify myMetrics:
-  for (unsigned i = 0; i < 10; ++i) {
-    myMetric = myMetric + 1.1;
-    myMetric_int = myMetric_int + 1;
-    myMetric_double = myMetric_double + 1;
-    myMetric_sizet = myMetric_sizet + 1;
-    // std::this_thread::sleep_for(5s);
+  // Called directly, as the compiler may remove a new expression paired with its delete
+  auto hook_allocations = allocations_in([] { ::operator delete(::operator new(sizeof(int))); });
+  check(accounting::enabled() && hook_allocations == 1, "allocation hooks are active", hook_allocations);
+
+  // Probes are updated on the hot path of every instrumented thread
+  LatencyProbe probe("test_probe");
+  probe.record(100);
+  auto probe_allocations = allocations_in([&] {
+    for (int i = 0; i < 10000; ++i) {
+      ScopedTimer timer(probe);
+    }
+  });
+  check(probe_allocations == 0, "LatencyProbe/ScopedTimer do not allocate", probe_allocations);
+
+  auto family = LabeledFamily<double>("opmonlib_test.Family", "link", { "rate", "errors" });
+  for (int l = 0; l < 64; ++l)
+    family.add_label(std::to_string(l));
+  auto family_allocations = allocations_in([&] {
+    for (size_t i = 0; i < 100000; ++i)
+      family.set(i % 2, i % 64, static_cast<double>(i));
+  });
+  check(family_allocations == 0, "LabeledFamily::set does not allocate", family_allocations);
+
+  // Metrics are updated on the hot path too
+  Counter counter("opmonlib_test.Counter");
+  Gauge gauge("opmonlib_test.Gauge");
+  Histogram histogram("opmonlib_test.Histogram");
+  auto metric_allocations = allocations_in([&] {
+    for (uint64_t i = 1; i <= 100; ++i) { // NOLINT(build/unsigned)
+      counter.increment();
+      gauge.add(0.5);
+      histogram.record(i);
+    }
+  });
+  check(metric_allocations == 0, "Counter/Gauge/Histogram updates do not allocate", metric_allocations);
+  counter.increment(900);
+  check(counter.get_value() == 1000, "Counter::increment adds up", counter.get_value());
+  gauge.add(-60.);
+  check(gauge.get_value() == -10., "Gauge::add adds up", static_cast<uint64_t>(-gauge.get_value())); // NOLINT
+  gauge.set(3.25);
+  check(gauge.get_value() == 3.25, "Gauge::set replaces the value", static_cast<uint64_t>(gauge.get_value())); // NOLINT
+  {
+    InfoCollector ic;
+    ic.add(counter);
+    ic.add(gauge);
+    auto& props = ic.get_collected_infos()["__properties"];
+    check(props["opmonlib_test.Counter"]["__data"]["count"] == 1000 &&
+            props["opmonlib_test.Gauge"]["__data"]["value"] == 3.25,
+          "InfoCollector::add publishes Counter and Gauge values",
+          props.size());
+  }
+
+  // Histogram percentiles are the centre of their power of two bucket, clamped to the maximum:
+  // of 1..100, the 50th value falls in [32, 64) and the 90th and 99th in [64, 128)
+  {
+    auto stats = histogram.get_stats();
+    check(stats.count == 100 && stats.sum == 5050. && stats.mean == 50.5 && stats.max == 100.,
+          "Histogram count, sum, mean and max",
+          stats.count);
+    check(stats.p50 == 48. && stats.p90 == 96. && stats.p99 == 96.,
+          "Histogram percentiles are bucket centres",
+          static_cast<uint64_t>(stats.p50)); // NOLINT(build/unsigned)
+
+    Histogram small("opmonlib_test.Small");
+    small.record(5);
+    check(small.get_stats().p50 == 5.,
+          "Histogram percentiles are clamped to the maximum",
+          static_cast<uint64_t>(small.get_stats().p50)); // NOLINT(build/unsigned)
+
+    Histogram zeros("opmonlib_test.Zeros");
+    check(zeros.get_stats().count == 0 && zeros.get_stats().p99 == 0., "empty Histogram", 0);
+    for (int i = 0; i < 99; ++i)
+      zeros.record(0);
+    zeros.record(1000);
+    auto z = zeros.get_stats();
+    check(z.count == 100 && z.p50 == 0. && z.p90 == 0. && z.p99 == 0. && z.max == 1000.,
+          "Histogram zero values have their own bucket",
+          static_cast<uint64_t>(z.p99)); // NOLINT(build/unsigned)
+
+    // Values with the top bit set land in the last bucket, [2^63, 2^64)
+    Histogram top("opmonlib_test.Top");
+    const auto largest = std::numeric_limits<uint64_t>::max(); // NOLINT(build/unsigned)
+    top.record(largest);
+    auto t = top.get_stats();
+    check(t.count == 1 && t.max == static_cast<double>(largest) && t.p50 == 1.5 * 9223372036854775808. &&
+            t.p99 == t.p50,
+          "Histogram top bucket holds 64-bit values",
+          static_cast<uint64_t>(t.p50)); // NOLINT(build/unsigned)
+  }
+
+  // Boolean fields of a record become 0/1 columns
+  {
+    auto links = LabeledFamily<double>::for_record<LinkInfo>("link");
+    links.add_label("a");
+    links.add_label("b");
+    links.set_record(0, LinkInfo{ 7, true, "a" });
+    links.set_record(1, LinkInfo{ 5, false, "b" });
+    check(links.get_field_names() == std::vector<std::string>{ "packets", "up" } && links.sum(0) == 12 &&
+            links.column(1)[0] == 1 && links.column(1)[1] == 0,
+          "LabeledFamily::set_record converts boolean fields",
+          static_cast<uint64_t>(links.sum(1))); // NOLINT(build/unsigned)
+  }
+
+  // Once every stream has written a block, appending reuses the buffers
+  {
+    std::ofstream devnull("/dev/null", std::ios::binary);
+    TimeSeriesWriter writer(devnull, 16);
+    std::vector<std::string> series = { "partition.module/test.Info/counter", "partition.module/test.Info/rate" };
+    auto append = [&](int64_t t) {
+      writer.append(series[0], t, static_cast<int64_t>(t * 3));
+      writer.append(series[1], t, 0.5 * static_cast<double>(t));
+    };
+    for (int64_t t = 0; t < 40; ++t)
+      append(t);
+    auto ts_allocations = allocations_in([&] {
+      for (int64_t t = 40; t < 10000; ++t)
+        append(t);
+    });
+    check(ts_allocations == 0, "TimeSeriesWriter::append does not allocate in steady state", ts_allocations);
+  }
+
+  // The file service issues one write per flush for small snapshots
+  Root root;
+  for (auto flush : { 1, 10 }) {
+    auto file = "/tmp/opmonlib_test_" + std::to_string(getpid()) + ".json";
+    {
+      InfoManager manager("file://" + file + "?flush=" + std::to_string(flush));
+      manager.set_provider(root);
+      manager.publish_info(0); // Opens buffers and caches
+
+      uint64_t gather_writes = 0, publish_writes = 0; // NOLINT(build/unsigned)
+      const int cycles = 100;
+      for (int i = 0; i < cycles; ++i) {
+        root.leaves[0].info.sent = i;
+        manager.publish_info(0);
+        gather_writes += manager.get_phase_counts().gather.writes;
+        publish_writes += manager.get_phase_counts().publish.writes;
+      }
+      check(gather_writes == 0, "gather_info does not write", gather_writes);
+      check(publish_writes <= static_cast<uint64_t>(cycles / flush), // NOLINT(build/unsigned)
+            "file://?flush=" + std::to_string(flush) + " writes at most once per " + std::to_string(flush) +
+              " publications",
+            publish_writes);
+    }
+    std::remove(file.c_str());
   }
 
-  mregistry.getValueOfMetric<std::atomic<float>>("Temperature");
-  mregistry.getValueOfMetric<std::atomic<int>>("Humidity");
-  mmonitor.monitor(mregistry.getMetrics());
+  std::cout << (s_failures == 0 ? "All checks passed" : std::to_string(s_failures) + " checks failed") << std::endl;
+  return s_failures == 0 ? 0 : 1;
 }